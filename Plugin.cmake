@@ -55,6 +55,11 @@ SET(SRC
     src/AutopilotRouteUI.cpp
     src/concanv.cpp
     src/computation.cpp
+    src/route.cpp
+    src/route_response.cpp
+    src/route_receiver.cpp
+    src/nmea_sentence.cpp
+    src/nmea_output.cpp
     src/georef.c
     src/icons.cpp
 #    src/ODAPI.h
@@ -68,6 +73,13 @@ SET(INC
 	src/georef.c
     src/concanv.h
     src/computation.h
+    src/route.h
+    src/route_response.h
+    src/route_receiver.h
+    src/nmea_sentence.h
+    src/nmea_output.h
+    src/navigation.h
+    src/geometry.h
 	src/AutopilotRouteUI.h
     src/autopilot_route_pi.h
 	src/wxWTranslateCatalog.h
@@ -78,6 +90,8 @@ add_definitions(-DPLUGIN_USE_SVG)
 
 set (SOURCE_FILES ${SRC} ${INC})
 
+option(AUTOPILOT_ROUTE_TESTS "Build the tests and benchmarks, run with ctest" OFF)
+
 macro(late_init)
   # Perform initialization after the PACKAGE_NAME library, compilers
   # and ocpn::api is available.
@@ -88,13 +102,15 @@ endmacro ()
 
 macro(add_plugin_libraries)
 
-    add_subdirectory(opencpn-libs/nmea0183)
-    target_link_libraries(${PACKAGE_NAME} ocpn::nmea0183)
-
     add_subdirectory(opencpn-libs/plugin_dc)
     target_link_libraries(${PACKAGE_NAME} ocpn::plugin-dc)
 
     add_subdirectory(opencpn-libs/jsoncpp)
     target_link_libraries(${PACKAGE_NAME} ocpn::jsoncpp)
 
+    if (AUTOPILOT_ROUTE_TESTS)
+      enable_testing()
+      add_subdirectory(test)
+    endif ()
+
 endmacro ()
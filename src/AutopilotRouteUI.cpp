@@ -158,7 +158,7 @@ PreferencesDialogBase::PreferencesDialogBase( wxWindow* parent, wxWindowID id, c
 	fgSizer171->SetFlexibleDirection( wxBOTH );
 	fgSizer171->SetNonFlexibleGrowMode( wxFLEX_GROWMODE_SPECIFIED );
 
-	wxString m_cRateChoices[] = { _("1"), _("2"), _("5"), _("10") };
+	wxString m_cRateChoices[] = { _("1"), _("2"), _("5"), _("10"), _("20") };
 	int m_cRateNChoices = sizeof( m_cRateChoices ) / sizeof( wxString );
 	m_cRate = new wxChoice( sbSizer6->GetStaticBox(), wxID_ANY, wxDefaultPosition, wxDefaultSize, m_cRateNChoices, m_cRateChoices, 0 );
 	m_cRate->SetSelection( 0 );
@@ -168,12 +168,32 @@ PreferencesDialogBase::PreferencesDialogBase( wxWindow* parent, wxWindowID id, c
 	m_staticText13->Wrap( -1 );
 	fgSizer171->Add( m_staticText13, 0, wxALL, 5 );
 
+	wxString m_cOutputChoices[] = { _("OpenCPN"), _("UDP"), _("TCP server"), _("Serial") };
+	int m_cOutputNChoices = sizeof( m_cOutputChoices ) / sizeof( wxString );
+	m_cOutput = new wxChoice( sbSizer6->GetStaticBox(), wxID_ANY, wxDefaultPosition, wxDefaultSize, m_cOutputNChoices, m_cOutputChoices, 0 );
+	m_cOutput->SetSelection( 0 );
+	fgSizer171->Add( m_cOutput, 0, wxALL, 5 );
+
+	m_tOutputAddress = new wxTextCtrl( sbSizer6->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, 0 );
+	m_tOutputAddress->SetToolTip( _("host:port, or serial device:baud") );
+
+	fgSizer171->Add( m_tOutputAddress, 0, wxALL|wxEXPAND, 5 );
+
 
 	fgSizer17->Add( fgSizer171, 1, wxEXPAND, 5 );
 
 	m_cbMagnetic = new wxCheckBox( sbSizer6->GetStaticBox(), wxID_ANY, _("Magnetic"), wxDefaultPosition, wxDefaultSize, 0 );
 	fgSizer17->Add( m_cbMagnetic, 0, wxALL, 5 );
 
+	m_cbFixTriggered = new wxCheckBox( sbSizer6->GetStaticBox(), wxID_ANY, _("On each fix"), wxDefaultPosition, wxDefaultSize, 0 );
+	fgSizer17->Add( m_cbFixTriggered, 0, wxALL, 5 );
+
+	m_cbPredict = new wxCheckBox( sbSizer6->GetStaticBox(), wxID_ANY, _("Dead reckon between fixes"), wxDefaultPosition, wxDefaultSize, 0 );
+	fgSizer17->Add( m_cbPredict, 0, wxALL, 5 );
+
+	m_cbOnChange = new wxCheckBox( sbSizer6->GetStaticBox(), wxID_ANY, _("Send on significant change"), wxDefaultPosition, wxDefaultSize, 0 );
+	fgSizer17->Add( m_cbOnChange, 0, wxALL, 5 );
+
 
 	fgSizer161->Add( fgSizer17, 1, wxEXPAND, 5 );
 
@@ -254,7 +274,7 @@ PreferencesDialogBase::PreferencesDialogBase( wxWindow* parent, wxWindowID id, c
 	m_cbInterceptRoute = new wxCheckBox( sbSizer10->GetStaticBox(), wxID_ANY, _("Intercept Route"), wxDefaultPosition, wxDefaultSize, 0 );
 	fgSizer45->Add( m_cbInterceptRoute, 0, wxALL, 5 );
 
-	wxString m_cComputationChoices[] = { _("Great Circle (Shortest Distance)"), _("Mercator (Constant Bearings)") };
+	wxString m_cComputationChoices[] = { _("Great Circle (Shortest Distance)"), _("Mercator (Constant Bearings)"), _("Great Circle (Fast Approximation)") };
 	int m_cComputationNChoices = sizeof( m_cComputationChoices ) / sizeof( wxString );
 	m_cComputation = new wxChoice( sbSizer10->GetStaticBox(), wxID_ANY, wxDefaultPosition, wxDefaultSize, m_cComputationNChoices, m_cComputationChoices, 0 );
 	m_cComputation->SetSelection( 0 );
@@ -280,7 +300,7 @@ PreferencesDialogBase::PreferencesDialogBase( wxWindow* parent, wxWindowID id, c
 	m_cbActiveRouteItems0 = new wxCheckListBox( sbSizer5->GetStaticBox(), wxID_ANY, wxDefaultPosition, wxSize( -1,-1 ), m_cbActiveRouteItems0NChoices, m_cbActiveRouteItems0Choices, 0 );
 	fgSizer16->Add( m_cbActiveRouteItems0, 0, wxALL|wxEXPAND, 5 );
 
-	wxString m_cbActiveRouteItems1Choices[] = { _("Route ETA"), _("Route RNG"), _("Route TTG"), _("Highway"), _("Deactivate") };
+	wxString m_cbActiveRouteItems1Choices[] = { _("Route ETA"), _("Route RNG"), _("Route TTG"), _("Highway"), _("Waypoints"), _("Deactivate") };
 	int m_cbActiveRouteItems1NChoices = sizeof( m_cbActiveRouteItems1Choices ) / sizeof( wxString );
 	m_cbActiveRouteItems1 = new wxCheckListBox( sbSizer5->GetStaticBox(), wxID_ANY, wxDefaultPosition, wxSize( -1,-1 ), m_cbActiveRouteItems1NChoices, m_cbActiveRouteItems1Choices, 0 );
 	fgSizer16->Add( m_cbActiveRouteItems1, 0, wxALL, 5 );
@@ -61,7 +61,12 @@ class PreferencesDialogBase : public wxDialog
 		wxStaticText* m_staticText30;
 		wxChoice* m_cRate;
 		wxStaticText* m_staticText13;
+		wxChoice* m_cOutput;
+		wxTextCtrl* m_tOutputAddress;
 		wxCheckBox* m_cbMagnetic;
+		wxCheckBox* m_cbFixTriggered;
+		wxCheckBox* m_cbPredict;
+		wxCheckBox* m_cbOnChange;
 		wxCheckListBox* m_cbNMEASentences;
 		wxCheckBox* m_cbBoundary;
 		wxTextCtrl* m_tBoundary;
@@ -57,7 +57,7 @@ bool PreferencesDialog::Show( bool show )
         // Waypoint Arrival
         m_cbConfirmBearingChange->SetValue(p.confirm_bearing_change);
         m_cbInterceptRoute->SetValue(p.intercept_route);
-        m_cComputation->SetSelection(p.computation == autopilot_route_pi::preferences::MERCATOR);
+        m_cComputation->SetSelection(p.computation);
 
         // Boundary
         m_tBoundary->SetValue(p.boundary_guid);
@@ -73,6 +73,11 @@ bool PreferencesDialog::Show( bool show )
             }
 
         m_cbMagnetic->SetValue(p.magnetic);
+        m_cbFixTriggered->SetValue(p.fix_triggered);
+        m_cbPredict->SetValue(p.predict);
+        m_cbOnChange->SetValue(p.nmea_on_change);
+        m_cOutput->SetSelection(p.output);
+        m_tOutputAddress->SetValue(p.output_address);
         for(unsigned int i=0; i<m_cbNMEASentences->GetCount(); i++)
             if(p.nmea_sentences.find(m_cbNMEASentences->GetString(i)) != p.nmea_sentences.end())
                 m_cbNMEASentences->Check(i, p.nmea_sentences[m_cbNMEASentences->GetString(i)]);
@@ -100,39 +105,60 @@ void PreferencesDialog::OnCancel( wxCommandEvent& event )
 void PreferencesDialog::OnOk( wxCommandEvent& event )
 {
     autopilot_route_pi::preferences &p = m_pi.prefs;
+    bool output = false;
+    {
+        wxMutexLocker lock(m_pi.m_nav_mutex); // the navigation thread reads the preferences
 
-    // Mode
-    p.mode = m_cbMode->GetPageText(m_cbMode->GetSelection());
-    p.xte_multiplier = m_sXTEP->GetValue() / 100.0;
-    p.route_position_bearing_mode = (autopilot_route_pi::preferences::RoutePositionBearingMode)
-        m_cbRoutePositionBearingMode->GetSelection();
-    p.route_position_bearing_distance = m_sRoutePositionBearingDistance->GetValue();
-    p.route_position_bearing_time = m_sRoutePositionBearingTime->GetValue();
-    p.route_position_bearing_max_angle = m_sRoutePositionBearingMaxAngle->GetValue();
-    
-    // Active Route Window
-    wxCheckListBox *cbActiveRouteItems[2] = {m_cbActiveRouteItems0, m_cbActiveRouteItems1};
-    for(unsigned int ind = 0; ind < 2; ind++)
-        for(unsigned int i=0; i<cbActiveRouteItems[ind]->GetCount(); i++)
-            p.active_route_labels[ind][cbActiveRouteItems[ind]->GetString(i)]
-                = cbActiveRouteItems[ind]->IsChecked(i);
-
-    // Waypoint Arrival
-    p.confirm_bearing_change = m_cbConfirmBearingChange->GetValue();
-    p.intercept_route = m_cbInterceptRoute->GetValue();
-    p.computation = (autopilot_route_pi::preferences::ComputationType)m_cComputation->GetSelection();
-
-    // Boundary
-    p.boundary_guid = m_tBoundary->GetValue();
-    p.boundary_width = m_sBoundaryWidth->GetValue();
-
-    // NMEA output
-    long l;
-    if(m_cRate->GetStringSelection().ToLong(&l))
-        p.rate = l;
-    p.magnetic = m_cbMagnetic->GetValue();
-    for(unsigned int i=0; i<m_cbNMEASentences->GetCount(); i++)
-        p.nmea_sentences[m_cbNMEASentences->GetString(i)] = m_cbNMEASentences->IsChecked(i);
+        // Mode
+        p.mode = m_cbMode->GetPageText(m_cbMode->GetSelection());
+        p.xte_multiplier = m_sXTEP->GetValue() / 100.0;
+        p.route_position_bearing_mode = (autopilot_route_pi::preferences::RoutePositionBearingMode)
+            m_cbRoutePositionBearingMode->GetSelection();
+        p.route_position_bearing_distance = m_sRoutePositionBearingDistance->GetValue();
+        p.route_position_bearing_time = m_sRoutePositionBearingTime->GetValue();
+        p.route_position_bearing_max_angle = m_sRoutePositionBearingMaxAngle->GetValue();
+
+        // Active Route Window
+        wxCheckListBox *cbActiveRouteItems[2] = {m_cbActiveRouteItems0, m_cbActiveRouteItems1};
+        for(unsigned int ind = 0; ind < 2; ind++)
+            for(unsigned int i=0; i<cbActiveRouteItems[ind]->GetCount(); i++)
+                p.active_route_labels[ind][cbActiveRouteItems[ind]->GetString(i)]
+                    = cbActiveRouteItems[ind]->IsChecked(i);
+
+        // Waypoint Arrival
+        p.confirm_bearing_change = m_cbConfirmBearingChange->GetValue();
+        p.intercept_route = m_cbInterceptRoute->GetValue();
+        autopilot_route_pi::preferences::ComputationType computation = p.computation;
+        p.computation = (autopilot_route_pi::preferences::ComputationType)m_cComputation->GetSelection();
+        if(p.computation != computation) {
+            m_pi.SetComputation();
+            m_pi.CompileRoute(); // leg bearings depend on the computation
+        }
+
+        // Boundary
+        p.boundary_guid = m_tBoundary->GetValue();
+        p.boundary_width = m_sBoundaryWidth->GetValue();
+
+        // NMEA output
+        long l;
+        if(m_cRate->GetStringSelection().ToLong(&l))
+            p.rate = l;
+        p.magnetic = m_cbMagnetic->GetValue();
+        p.fix_triggered = m_cbFixTriggered->GetValue();
+        p.predict = m_cbPredict->GetValue();
+        p.nmea_on_change = m_cbOnChange->GetValue();
+        for(unsigned int i=0; i<m_cbNMEASentences->GetCount(); i++)
+            p.nmea_sentences[m_cbNMEASentences->GetString(i)] = m_cbNMEASentences->IsChecked(i);
+        p.Compile();
+        if(p.output != m_cOutput->GetSelection() || p.output_address != m_tOutputAddress->GetValue()) {
+            p.output = m_cOutput->GetSelection();
+            p.output_address = m_tOutputAddress->GetValue();
+            output = true;
+        }
+    }
+    if(output)
+        m_pi.SetOutput(); // takes the lock itself, opening may block
+    m_pi.WakeNavigation(); // navigate with the new preferences
 
     if(IsModal())
         EndModal(wxID_OK);
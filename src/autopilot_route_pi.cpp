@@ -28,13 +28,17 @@
 #include <wx/stdpaths.h>
 #include <wx/aui/aui.h>
 
+#include <utility>
+
 #include "pidc.h"
 
 #include "json/json.h"
 
-#include "nmea0183.h"
+#include "nmea_sentence.h"
 
 #include "georef.h"
+#include "geometry.h"
+#include "route_response.h"
 
 #include "autopilot_route_pi.h"
 #include "concanv.h"
@@ -63,12 +67,6 @@ extern "C" DECL_EXP void destroy_pi(opencpn_plugin* p)
     delete p;
 }
 
-waypoint::waypoint(double lat, double lon, wxString n, wxString guid,
-                   double ar, double ab)
-    : wp(lat, lon), name(n), GUID(guid), arrival_radius(ar), arrival_bearing(ab)
-{
-}
-
 
 //-----------------------------------------------------------------------------
 //
@@ -77,14 +75,23 @@ waypoint::waypoint(double lat, double lon, wxString n, wxString guid,
 //-----------------------------------------------------------------------------
 
 autopilot_route_pi::autopilot_route_pi(void *ppimgr)
-    : opencpn_plugin_118(ppimgr)
+    : opencpn_plugin_118(ppimgr), m_receiver(m_route, m_segment_index)
 {
     // Create the PlugIn icons
     initialize_images();
     m_ConsoleCanvas = NULL;
     m_PreferencesDialog = NULL;
     m_avg_sog=0;
+    m_solved = false;
+    m_last_wpt_activated = -1;
+    m_route_ended = false;
+    m_confirm_advance = CONFIRM_NONE;
+    m_confirm_wp = -1;
+    m_nav_thread = NULL;
+    m_output = NULL;
     m_declination = NAN;
+    m_engine = Engine<great_circle>();
+    m_receiver.geometry = Geometry<great_circle>();
 	
 // Create the PlugIn icons  -from shipdriver
 // loads png file for the listing panel icon
@@ -149,7 +156,14 @@ int autopilot_route_pi::Init(void)
     // options
     p.confirm_bearing_change = (bool)pConf->Read("ConfirmBearingChange", 0L);
     p.intercept_route = (bool)pConf->Read("InterceptRoute", 1L);
-    p.computation = pConf->Read("Computation", "Great Circle") == "Mercator" ? preferences::MERCATOR : preferences::GREAT_CIRCLE;
+    wxString computation = pConf->Read("Computation", "Great Circle");
+    if(computation == "Mercator")
+        p.computation = preferences::MERCATOR;
+    else if(computation == "Great Circle Fast")
+        p.computation = preferences::GREAT_CIRCLE_FAST;
+    else
+        p.computation = preferences::GREAT_CIRCLE;
+    SetComputation();
 
     // Boundary
     p.boundary_guid = pConf->Read("Boundary", "");
@@ -158,16 +172,34 @@ int autopilot_route_pi::Init(void)
     // NMEA output
     p.rate = pConf->Read("NMEARate", 1L);
     p.magnetic = (bool)pConf->Read("NMEAMagnetic", 0L);
+    p.fix_triggered = (bool)pConf->Read("NMEAOnFix", 0L);
+    p.predict = (bool)pConf->Read("NMEAPredict", 0L);
     wxString sentences = pConf->Read("NMEASentences", "APB;");
     while(sentences.size()) {
         p.nmea_sentences[sentences.BeforeFirst(';')] = true;
         sentences = sentences.AfterFirst(';');
     }
+    for(int i=0; i<preferences::NMEA_SENTENCES; i++)
+        p.nmea_rates[i] = pConf->Read(wxString("NMEARate") + preferences::nmea_sentence_names[i], 0.0);
+    p.nmea_on_change = (bool)pConf->Read("NMEAOnChange", 0L);
+    p.nmea_change_bearing = pConf->Read("NMEAChangeBearing", 1.0);
+    p.nmea_change_xte = pConf->Read("NMEAChangeXTE", .01);
+    p.output = pConf->Read("NMEAOutput", 0L);
+    p.output_address = pConf->Read("NMEAOutputAddress", "");
+    p.Compile();
+    SetOutput();
 
     PlugInHandleAutopilotRoute(true);
     m_Timer.Connect(wxEVT_TIMER, wxTimerEventHandler
                     ( autopilot_route_pi::OnTimer ), NULL, this);
 
+    m_nav_thread = new NavigationThread(*this);
+    if(m_nav_thread->Run() != wxTHREAD_NO_ERROR) {
+        wxLogMessage("autopilot_route_pi: failed to start navigation thread");
+        delete m_nav_thread;
+        m_nav_thread = NULL;
+    }
+
     return (WANTS_OVERLAY_CALLBACK |
             WANTS_OPENGL_OVERLAY_CALLBACK |
             WANTS_CURSOR_LATLON       |
@@ -182,6 +214,16 @@ int autopilot_route_pi::Init(void)
 bool autopilot_route_pi::DeInit(void)
 {    
     PlugInHandleAutopilotRoute(false);
+    if(m_nav_thread) {
+        m_nav_thread->Stop();
+        delete m_nav_thread;
+        m_nav_thread = NULL;
+    }
+    if(m_output) {
+        m_output->Stop();
+        delete m_output;
+        m_output = NULL;
+    }
     delete m_PreferencesDialog;
 
     m_Timer.Disconnect(wxEVT_TIMER, wxTimerEventHandler( autopilot_route_pi::OnTimer ), NULL, this);
@@ -222,7 +264,8 @@ bool autopilot_route_pi::DeInit(void)
     // Waypoint Arrival
     pConf->Write("ConfirmBearingChange", p.confirm_bearing_change);
     pConf->Write("InterceptRoute", p.intercept_route);
-    pConf->Write("Computation", p.computation == preferences::MERCATOR ? "Mercator" : "Great Circle");
+    pConf->Write("Computation", p.computation == preferences::MERCATOR ? "Mercator" :
+                 p.computation == preferences::GREAT_CIRCLE_FAST ? "Great Circle Fast" : "Great Circle");
 
     // Boundary
     pConf->Write("Boundary", p.boundary_guid);
@@ -231,16 +274,54 @@ bool autopilot_route_pi::DeInit(void)
     // NMEA output
     pConf->Write("NMEARate", p.rate);
     pConf->Write("NMEAMagnetic", p.magnetic);
+    pConf->Write("NMEAOnFix", p.fix_triggered);
+    pConf->Write("NMEAPredict", p.predict);
     wxString sentences;
     for(std::map<wxString, bool>::iterator it = p.nmea_sentences.begin();
         it != p.nmea_sentences.end(); it++)
         if(p.nmea_sentences[it->first])
             sentences += it->first + ";";
     pConf->Write("NMEASentences", sentences);
+    for(int i=0; i<preferences::NMEA_SENTENCES; i++)
+        pConf->Write(wxString("NMEARate") + preferences::nmea_sentence_names[i], p.nmea_rates[i]);
+    pConf->Write("NMEAOnChange", p.nmea_on_change);
+    pConf->Write("NMEAChangeBearing", p.nmea_change_bearing);
+    pConf->Write("NMEAChangeXTE", p.nmea_change_xte);
+    pConf->Write("NMEAOutput", p.output);
+    pConf->Write("NMEAOutputAddress", p.output_address);
 
     return true;
 }
 
+const char *const autopilot_route_pi::preferences::active_route_label_names[] =
+{"XTE", "BRG", "RNG", "TTG", "VMG", "Route ETA", "Route RNG", "Route TTG",
+ "Highway", "Waypoints", "Deactivate"};
+
+const char *const autopilot_route_pi::preferences::nmea_sentence_names[] =
+{"RMB", "RMC", "APB", "XTE"};
+
+static unsigned int CompileMask(std::map<wxString, bool> &map, const char *const names[], int count)
+{
+    unsigned int mask = 0;
+    for(int i=0; i<count; i++) {
+        std::map<wxString, bool>::iterator it = map.find(names[i]);
+        if(it != map.end() && it->second)
+            mask |= 1<<i;
+    }
+    return mask;
+}
+
+void autopilot_route_pi::preferences::Compile()
+{
+    for(int i=0; i<2; i++)
+        active_route_label_mask[i] = CompileMask(active_route_labels[i], active_route_label_names, LABELS);
+    nmea_sentence_mask = CompileMask(nmea_sentences, nmea_sentence_names, NMEA_SENTENCES);
+
+    // an unknown mode is resolved here rather than by the navigation thread
+    if(mode != "Standard XTE" && mode != "Waypoint Bearing" && mode != "Route Position Bearing")
+        mode = "Route Position Bearing";
+}
+
 int autopilot_route_pi::GetAPIVersionMajor()
 {
     return atoi(API_VERSION);
@@ -429,28 +510,87 @@ double autopilot_route_pi::Declination()
     return m_declination;
 }
 
-bool autopilot_route_pi::GetConsoleInfo(double &sog, double &cog,
-                                        double &bearing, double &xte,
-                                        double *rng, double *nrng)
+// the latest state published by the navigation thread, gui thread only
+const nav_state &autopilot_route_pi::NavState()
 {
-    sog = m_lastfix.Sog;
-    cog = m_lastfix.Cog;
-    bearing = m_current_bearing;
-    xte = m_current_xte;
+    m_nav_state.fetch();
+    return m_nav_state.front();
+}
 
-    if(rng) {
-        double rbrg;
-        DistanceBearing(m_lastfix.Lat, m_lastfix.Lon,
-                        m_current_wp.lat, m_current_wp.lon, &rbrg, rng);
-        *nrng = *rng * cos((rbrg - bearing)*M_PI/180);
+// distance along the route from the current waypoint to the end,
+// from the distances compiled with the route
+double autopilot_route_pi::Remaining()
+{
+    if(prefs.mode == "Route Position Bearing") {
+        if(!m_cursor.valid(m_route))
+            return 0;
+        return m_route.route_distance.back() - m_cursor.along_track;
     }
-    
-    return true;
+    if(m_current_wp.index < 0)
+        return 0;
+    return m_route.remaining(m_current_wp.index);
+}
+
+// first route waypoint ahead of the boat, -1 if not known
+int autopilot_route_pi::NextWaypoint()
+{
+    if(prefs.mode == "Route Position Bearing")
+        return m_cursor.valid(m_route) ? m_cursor.segment + 1 : -1;
+    return m_current_wp.index;
+}
+
+void autopilot_route_pi::UpdateETA()
+{
+    int next = NextWaypoint();
+    if(next < m_route.start) {
+        m_eta.reset();
+        return;
+    }
+
+    double along = m_route.route_distance.back() - (m_solution.rng + m_solution.remaining);
+    m_eta.update(next, along, m_avg_sog, wxDateTime::Now());
+}
+
+void autopilot_route_pi::SendETA()
+{
+    const eta_schedule &eta = NavState().eta;
+    Json::FastWriter w;
+    Json::Value v;
+    v["GUID"] = std::string(m_active_guid);
+    {
+        // built with the route held, sent after
+        wxMutexLocker lock(m_nav_mutex);
+        bool valid = eta.next >= m_route.start && eta.next < m_route.size() && eta.speed > 0;
+        v["error"] = !valid;
+        for(int i=eta.next; valid && i<m_route.size(); i++) {
+            Json::Value e;
+            e["GUID"] = std::string(m_route.GUID[i]);
+            e["Name"] = std::string(m_route.name[i]);
+            e["Distance"] = eta.distance(m_route, i);
+            e["ETA"] = std::string(eta.eta(m_route, i).ToUTC().FormatISOCombined());
+            v["waypoints"].append(e);
+        }
+    }
+    SendPluginMessage("AUTOPILOT_ROUTE_ETA", w.write(v));
+}
+
+// fix to sentence latency of the nmea output
+void autopilot_route_pi::SendLatency()
+{
+    const latency_stats &l = NavState().latency;
+    Json::FastWriter w;
+    Json::Value v;
+    v["Count"] = l.count;
+    v["Last"] = l.last;
+    v["Average"] = l.average;
+    v["Max"] = l.max;
+    SendPluginMessage("AUTOPILOT_ROUTE_LATENCY", w.write(v));
 }
 
 void autopilot_route_pi::DeactivateRoute()
 {
     SendPluginMessage("OCPN_RTE_DEACTIVATED", "");
+    wxMutexLocker lock(m_nav_mutex);
     m_current_wp.GUID = "";    
 }
 
@@ -458,54 +598,58 @@ void autopilot_route_pi::Render(piDC &dc, PlugIn_ViewPort &vp)
 {
     if(m_active_guid.IsEmpty())
         return;
+
+    const nav_state &s = NavState();
+    if(!s.valid)
+        return;
     
     if(prefs.mode != "Route Position Bearing")
-        RenderArrivalWaypoint(dc, vp);
+        RenderArrivalWaypoint(dc, vp, s.current_wp);
     else
-        RenderRoutePositionBearing(dc, vp);
+        RenderRoutePositionBearing(dc, vp, s.current_wp);
     
     wxPoint r1, r2;
-    GetCanvasPixLL(&vp, &r1, m_current_wp.lat, m_current_wp.lon);
-    GetCanvasPixLL(&vp, &r2, m_lastfix.Lat, m_lastfix.Lon);
+    GetCanvasPixLL(&vp, &r1, s.current_wp.lat, s.current_wp.lon);
+    GetCanvasPixLL(&vp, &r2, s.lat, s.lon);
     dc.SetPen(wxPen(*wxRED, 2));
 
     #if 1
     double r = hypot(r1.x-r2.x, r1.y-r2.y);
-    r1.x = r2.x+r*sin(m_current_bearing*M_PI/180);
-    r1.y = r2.y-r*cos(m_current_bearing*M_PI/180);
+    r1.x = r2.x+r*sin(s.solution.bearing*M_PI/180);
+    r1.y = r2.y-r*cos(s.solution.bearing*M_PI/180);
     #endif
     
     dc.DrawLine(r1.x, r1.y, r2.x, r2.y);
 }
 
-void autopilot_route_pi::RenderArrivalWaypoint(piDC &dc, PlugIn_ViewPort &vp)
+void autopilot_route_pi::RenderArrivalWaypoint(piDC &dc, PlugIn_ViewPort &vp, const waypoint &w)
 {
     wxPoint r1, r2;
     dc.SetPen(wxPen(*wxGREEN, 2));
-    GetCanvasPixLL(&vp, &r1, m_current_wp.lat, m_current_wp.lon);
-    GetCanvasPixLL(&vp, &r2, m_current_wp.lat + m_current_wp.arrival_radius/60.0, m_current_wp.lon);
+    GetCanvasPixLL(&vp, &r1, w.lat, w.lon);
+    GetCanvasPixLL(&vp, &r2, w.lat + w.arrival_radius/60.0, w.lon);
 
     double radius = hypot(r1.x-r2.x, r1.y-r2.y);
     dc.DrawCircle( r1.x, r1.y, radius );
 
     dc.SetPen(wxPen(*wxGREEN, 1));
     double lat, lon;
-    double dist = 5 * m_current_wp.arrival_radius;
+    double dist = 5 * w.arrival_radius;
     
-    ll_gc_ll(m_current_wp.lat, m_current_wp.lon, m_current_wp.arrival_bearing + 90, dist, &lat, &lon);
+    ll_gc_ll(w.lat, w.lon, w.arrival_bearing + 90, dist, &lat, &lon);
     GetCanvasPixLL(&vp, &r2, lat, lon);
     dc.DrawLine(r1.x, r1.y, r2.x, r2.y);
     
-    ll_gc_ll(m_current_wp.lat, m_current_wp.lon, m_current_wp.arrival_bearing - 90, dist, &lat, &lon);
+    ll_gc_ll(w.lat, w.lon, w.arrival_bearing - 90, dist, &lat, &lon);
     GetCanvasPixLL(&vp, &r2, lat, lon);
     dc.DrawLine(r1.x, r1.y, r2.x, r2.y);
 }
 
-void autopilot_route_pi::RenderRoutePositionBearing(piDC &dc, PlugIn_ViewPort &vp)
+void autopilot_route_pi::RenderRoutePositionBearing(piDC &dc, PlugIn_ViewPort &vp, const waypoint &w)
 {
     wxPoint r1;
     dc.SetPen(wxPen(*wxGREEN, 2));
-    GetCanvasPixLL(&vp, &r1, m_current_wp.lat, m_current_wp.lon);
+    GetCanvasPixLL(&vp, &r1, w.lat, w.lon);
     dc.DrawCircle( r1.x, r1.y, 10 );
 }
 
@@ -514,27 +658,182 @@ void autopilot_route_pi::OnTimer( wxTimerEvent & )
     if(m_active_guid.IsEmpty())
         return;
 
-    // for now poll active route (not efficient)
-    if((wxDateTime::Now() - m_active_request_time).GetSeconds() > 10) {
+    // request the active route when notified it changed, changes not
+    // notified are still picked up by polling slowly
+    if(m_refresh.due(wxDateTime::Now())) {
         RequestRoute(m_active_guid);
         if(m_active_guid.IsEmpty())
             return;
     }
     
-    Recompute();
+    // the navigation itself is computed on the navigation thread
+    m_ConsoleCanvas->UpdateRouteData();
+}
+
+NavigationThread::NavigationThread(autopilot_route_pi &pi)
+    : wxThread(wxTHREAD_JOINABLE), m_pi(pi), m_stop(false), m_woken(false)
+{
+}
 
-    if(!m_active_guid.IsEmpty()) {
-        m_ConsoleCanvas->UpdateRouteData();
-        SendNMEA();
+void NavigationThread::Stop()
+{
+    m_stop = true;
+    Wake();
+    Wait();
+}
+
+wxThread::ExitCode NavigationThread::Entry()
+{
+    int period = 1000;
+    while(!m_stop) {
+        bool timeout = m_wake.WaitTimeout(period) == wxSEMA_TIMEOUT;
+        if(!m_stop)
+            period = m_pi.Navigate(timeout || m_woken.exchange(false));
+    }
+    return 0;
+}
+
+// one navigation update on the navigation thread, forced by the watchdog
+// or a wake when triggered by fixes, returns the milliseconds until the next
+int autopilot_route_pi::Navigate(bool force)
+{
+    wxMutexLocker lock(m_nav_mutex);
+    bool fresh = m_fix_mailbox.fetch();
+    if(fresh) {
+        const received_fix &r = m_fix_mailbox.front();
+        m_lastfix = r.fix;
+        if(m_lastfix.nSats > 3)
+            m_avg_sog = m_avg_sog*.9 + m_lastfix.Sog*.1;
+        m_dead_reckoning.fix(r.fix.Lat, r.fix.Lon, r.fix.Sog, r.fix.Cog, r.time);
+    } else if(prefs.predict) {
+        // between fixes navigate from where the boat should be by now
+        double dt = m_dead_reckoning.predict(std::chrono::steady_clock::now(),
+                                             m_lastfix.Lat, m_lastfix.Lon, m_lastfix.Cog);
+        // and send the time it should be there with the position, a fix
+        // without a time leaves rmc on the clock
+        if(dt >= 0 && m_fix_mailbox.front().fix.FixTime > 0)
+            m_lastfix.FixTime = m_fix_mailbox.front().fix.FixTime + (time_t)(dt + .5);
+    }
+
+    int period = prefs.fix_triggered ? NavigationThread::watchdog : 1000/prefs.rate;
+    // triggered by fixes, only the watchdog or a wake computes again on the same fix
+    if(prefs.fix_triggered && !fresh && !force)
+        return period;
+
+    if(!m_active_guid.IsEmpty() && !m_route_ended && !m_route.empty()) {
+        Recompute();
+        if(!m_route_ended) {
+            Solve();
+            UpdateETA();
+            SendNMEA();
+            if(fresh)
+                m_latency.add(std::chrono::duration<double, std::milli>
+                              (std::chrono::steady_clock::now() - m_fix_mailbox.front().time).count());
+        }
+    }
+
+    Publish();
+    return period;
+}
+
+// everything the output needs from the route computed by Recompute
+void autopilot_route_pi::Solve()
+{
+    nav_solution &n = m_solution;
+    // the waypoint range and bearing are already known from deciding
+    // whether to advance unless it is measured differently
+    if(!m_solved || prefs.computation == preferences::MERCATOR)
+        DistanceBearing(m_lastfix.Lat, m_lastfix.Lon, m_current_wp.lat, m_current_wp.lon,
+                        &n.wp_bearing, &n.rng);
+    n.arrival = m_bArrival;
+    n.leg_bearing = m_current_wp.arrival_bearing;
+    n.bearing = m_current_bearing;
+    n.xte = m_current_xte;
+    n.nrng = n.rng * cos((n.wp_bearing - n.bearing)*M_PI/180);
+    n.vmg = m_lastfix.Sog * cos((n.bearing - m_lastfix.Cog)*M_PI/180);
+    n.remaining = Remaining();
+}
+
+void autopilot_route_pi::Publish()
+{
+    nav_state &s = m_nav_state.back();
+    s.valid = !m_active_guid.IsEmpty() && !m_route_ended && !m_route.empty();
+    s.lat = m_lastfix.Lat;
+    s.lon = m_lastfix.Lon;
+    s.sog = m_lastfix.Sog;
+    s.cog = m_lastfix.Cog;
+    if(s.valid) {
+        s.current_wp = m_current_wp;
+        s.solution = m_solution;
+        s.eta = m_eta;
     }
+    s.latency = m_latency;
+    m_nav_state.publish();
+}
+
+// plugin messages are only sent from the gui thread
+void autopilot_route_pi::PostPluginMessage(const wxString &message_id, const wxString &message_body)
+{
+    CallAfter([this, message_id, message_body]() {
+        SendPluginMessage(message_id, message_body);
+    });
+}
+
+// the route ended on the navigation thread, which stops
+// navigating until the deactivation reaches the gui thread
+void autopilot_route_pi::EndRoute()
+{
+    m_route_ended = true;
+    m_current_wp.GUID = "";
+    PostPluginMessage("OCPN_RTE_DEACTIVATED", "");
+}
+
+// asked on the gui thread for AdvanceWaypoint
+void autopilot_route_pi::ConfirmAdvance()
+{
+    wxMessageDialog mdlg(GetOCPNCanvasWindow(), _("Advance Waypoint?"),
+                         _("Autopilot Route"), wxYES | wxNO);
+    m_confirm_advance = mdlg.ShowModal() == wxID_NO ? CONFIRM_NO : CONFIRM_YES;
+    WakeNavigation();
 }
 
 void autopilot_route_pi::Recompute()
 {
-    if(prefs.mode == "Standard XTE") ComputeXTE(); else
-    if(prefs.mode == "Waypoint Bearing") ComputeWaypointBearing(); else
-    if(prefs.mode == "Route Position Bearing") ComputeRoutePositionBearing(); else
-        prefs.mode = "Route Position Bearing";
+    m_solved = false;
+    if(prefs.mode == "Standard XTE") (this->*m_engine->ComputeXTE)(); else
+    if(prefs.mode == "Waypoint Bearing") (this->*m_engine->ComputeWaypointBearing)(); else
+    if(prefs.mode == "Route Position Bearing") (this->*m_engine->ComputeRoutePositionBearing)();
+}
+
+template<class G> const autopilot_route_pi::engine *autopilot_route_pi::Engine()
+{
+    static const engine e = { &autopilot_route_pi::ComputeXTE<G>,
+                              &autopilot_route_pi::ComputeWaypointBearing<G>,
+                              &autopilot_route_pi::ComputeRoutePositionBearing<G> };
+    return &e;
+}
+
+template<class G> route_geometry autopilot_route_pi::Geometry()
+{
+    route_geometry g = { &G::distance_bearing, &G::position_bearing };
+    return g;
+}
+
+void autopilot_route_pi::SetComputation()
+{
+    switch(prefs.computation) {
+    case preferences::MERCATOR:
+        m_engine = Engine<mercator>();
+        m_receiver.geometry = Geometry<mercator>();
+        break;
+    case preferences::GREAT_CIRCLE_FAST:
+        m_engine = Engine<great_circle_fast>();
+        m_receiver.geometry = Geometry<great_circle_fast>();
+        break;
+    default:
+        m_engine = Engine<great_circle>();
+        m_receiver.geometry = Geometry<great_circle>();
+    }
 }
 
 void autopilot_route_pi::SetCursorLatLon(double lat, double lon)
@@ -552,9 +851,13 @@ void autopilot_route_pi::SetNMEASentence(wxString &sentence)
 
 void autopilot_route_pi::SetPositionFixEx(PlugIn_Position_Fix_Ex &pfix)
 {
-    m_lastfix = pfix;
-    if(pfix.nSats > 3)
-        m_avg_sog = m_avg_sog*.9 + pfix.Sog*.1;
+    // handed to the navigation thread, which keeps m_lastfix
+    received_fix &r = m_fix_mailbox.back();
+    r.fix = pfix;
+    r.time = std::chrono::steady_clock::now();
+    m_fix_mailbox.publish();
+    if(prefs.fix_triggered && m_nav_thread)
+        m_nav_thread->Fix();
 }
 
 static bool ParseMessage(wxString &message_body, Json::Value &root)
@@ -577,129 +880,159 @@ void autopilot_route_pi::SetPluginMessage(wxString &message_id, wxString &messag
     
     if(message_id == wxS("AUTOPILOT_ROUTE_PI")) {
         return; // nothing yet
+    } else if(message_id == "AUTOPILOT_ROUTE_ETA_REQUEST") {
+        // schedule of the waypoints ahead, only built when asked for
+        SendETA();
+    } else if(message_id == "AUTOPILOT_ROUTE_LATENCY_REQUEST") {
+        SendLatency();
     } else if(message_id == wxS("AIS")) {
     } else if(message_id == _T("WMM_VARIATION_BOAT")) {
         if(ParseMessage( message_body, root )) {
+            wxMutexLocker lock(m_nav_mutex);
             wxString(root["Decl"].asString()).ToDouble(&m_declination);
             m_declinationTime = wxDateTime::Now();
         }
     } else if(message_id == "OCPN_RTE_ACTIVATED") {
         if(ParseMessage( message_body, root )) {
             // when route is activated, request the route
+            // and start it again even if it is the same route
+            m_receiver.reset();
             RequestRoute(root["GUID"].asString());
             ShowConsoleCanvas();
         }
     } else if(message_id == "OCPN_WPT_ACTIVATED") {
         wxString guid = root["GUID"].asString();
+        wxMutexLocker lock(m_nav_mutex);
         m_last_wpt_activated_guid = guid;
+        m_last_wpt_activated = m_route.find(guid);
         //ShowConsoleCanvas();
     } else if(message_id == "OCPN_WPT_ARRIVED") {
+    } else if(message_id == "OCPN_RTE_MODIFIED" || message_id == "OCPN_WPT_MODIFIED") {
+        // refetched on the next tick so a burst of edits is requested once
+        if(ParseMessage( message_body, root )) {
+            wxMutexLocker lock(m_nav_mutex);
+            m_refresh.modified(message_id, root["GUID"].asString(), m_active_guid, m_route);
+        }
     } else if(message_id == "OCPN_RTE_DEACTIVATED" || message_id == "OCPN_RTE_ENDED") {
         m_Timer.Stop();
-        m_active_guid = "";
+        {
+            wxMutexLocker lock(m_nav_mutex);
+            m_active_guid = "";
+        }
         m_active_request_guid = "";
+        m_receiver.reset();
         if( m_ConsoleCanvas ) {
             GetFrameAuiManager()->GetPane(m_ConsoleCanvas).Float();
             GetFrameAuiManager()->GetPane(m_ConsoleCanvas).Show(false);
             GetFrameAuiManager()->Update();
         }
     } else if(message_id == "OCPN_ROUTE_RESPONSE") {
-        if(!ParseMessage( message_body, root ))
+        wxScopedCharBuffer body = message_body.utf8_str();
+        route_response r;
+        switch(m_receiver.parse(body.data(), body.length(), m_active_request_guid, r)) {
+        case route_receiver::FAILED:
+            wxLogMessage(wxString::Format("autopilot_route_pi: Error parsing route response at %d",
+                                          r.error_offset));
             return;
-        
-        if(root["error"].asBool())
-            return;
-        
-        wxString guid = root["GUID"].asString();
-        if(guid != m_active_request_guid)
+        case route_receiver::IGNORED:
             return;
-        
-        m_active_request_time = wxDateTime::Now();        
-        m_active_guid = guid;
-        Json::Value w = root["waypoints"];
-
-        m_route.clear();
-        int size = w.size();
-        if(size < 2) {
-            SendPluginMessage("OCPN_RTE_ENDED", "");
+        case route_receiver::REPEATED:
+            m_refresh.received(wxDateTime::Now());
             return;
+        default:
+            break;
         }
+        m_refresh.received(wxDateTime::Now());
 
-        double lat0 = m_lastfix.Lat, lon0 = m_lastfix.Lon;
-        for(int i=0; i<size; i++) {
-            double lat = w[i]["lat"].asDouble(), lon = w[i]["lon"].asDouble();
-            double brg;
-            DistanceBearing(lat0, lon0, lat, lon, &brg, 0);
-            waypoint wp(lat, lon, w[i]["Name"].asString(), w[i]["GUID"].asString(),
-                        w[i]["ArrivalRadius"].asDouble(), brg);
-            
-            // set arrival bearing to current course for first waypoint
-            if(i == 0 && m_avg_sog > 1)
-                wp.arrival_bearing = m_lastfix.Cog;
-            m_route.push_back(wp);
-            lat0 = lat, lon0 = lon;
+        route_receiver::result result;
+        {
+            // the navigation thread waits while the route changes
+            wxMutexLocker lock(m_nav_mutex);
+            m_active_guid = r.GUID;
+            wp boat(m_lastfix.Lat, m_lastfix.Lon);
+            result = m_receiver.apply(r, boat, m_lastfix.Cog, m_avg_sog > 1);
+            if(result == route_receiver::UPDATED) {
+                m_last_wpt_activated = m_route.find(m_last_wpt_activated_guid);
+                if(m_current_wp.index >= 0 && m_receiver.dirty[m_current_wp.index])
+                    m_current_wp = m_route.at(m_current_wp.index);
+            } else if(result == route_receiver::NEW)
+                StartRoute(boat);
         }
 
-        ap_route_iterator it = m_route.begin(), closest;
-        wp boat(m_lastfix.Lat, m_lastfix.Lon);
-        wp p0 = *it;
-        double mindist = INFINITY;
-        // find closest segment
-        for(it++; it!=m_route.end(); it++) {
-            waypoint p1 = *it;
-            wp x = ClosestSeg(boat, p0, p1);
-            double dist = Distance(boat, x);
-            if(dist < mindist) {
-                mindist = dist;
-                closest = it;
-            }
-            p0 = p1;
+        if(result == route_receiver::ENDED)
+            SendPluginMessage("OCPN_RTE_ENDED", "");
+        else if(result == route_receiver::NEW) {
+            // navigate the new route at once
+            WakeNavigation();
+            m_Timer.Start(1000/prefs.rate);
         }
+    }
+}
 
-        closest--;
-        // delete items in m_route before closest
-        // this optimizes the iterative route calculations
-        if(closest != m_route.begin()) {
-            closest--;
-            m_route.erase(m_route.begin(), closest);
-        }
-        
+// a route received from scratch, compiled from its first waypoint, is
+// started from the segment closest to the boat
+void autopilot_route_pi::StartRoute(wp &boat)
+{
+    m_route_ended = false;
+    m_confirm_advance = CONFIRM_NONE;
+    // sent for the new route without waiting for the sentence rates
+    for(int i=0; i<preferences::NMEA_SENTENCES; i++)
+        m_nmea_schedule[i].reset();
+    // resolve the guids to their indices in this route once here
+    m_current_wp.index = m_current_wp.GUID.IsEmpty() ? -1 : m_route.find(m_current_wp.GUID);
+    m_last_wpt_activated = m_route.find(m_last_wpt_activated_guid);
+
+    int closest = 0;
+    // find closest segment
+    if(prefs.computation != preferences::MERCATOR) {
+        computation_gc::vector c = computation_gc::ll2v(boat);
+        closest = wxMax(m_segment_index.nearest(m_route, c, 0), 0);
+    } else {
+        wp x;
+        closest = wxMax(mercator::closest_seg_search(m_route, boat, 0, m_route.size()-1, x), 0);
+    }
 
-        if(prefs.intercept_route) {
-            wp boat(m_lastfix.Lat, m_lastfix.Lon);
-            
-            // do we intersect this segment on current course?
-            p0 = m_route.front();
-            it = m_route.begin();
-            it++;
-            waypoint p1 = *it;
-            // if intersect move p0 to intersection point
-            wp intersection;
-            if(Intersect(boat, m_lastfix.Cog, p0, p1, intersection)) {
-                m_route.pop_front();
-                waypoint i(intersection.lat, intersection.lon, "intersection", "",
-                           closest->arrival_radius, m_lastfix.Cog);
-                m_route.push_front(i);
-            }
+    // skip waypoints in m_route before closest
+    // this optimizes the iterative route calculations
+    if(closest > 0)
+        m_route.start = closest - 1;
+    m_cursor.reset();
+    m_eta.reset();
+    m_cursor.segment = closest;
+    m_cursor.position = boat;
+
+    if(prefs.intercept_route) {
+        // do we intersect this segment on current course?
+        int i = m_route.start;
+        // if intersect move p0 to intersection point
+        wp intersection;
+        if(Intersect(boat, m_lastfix.Cog, i, intersection)) {
+            waypoint wi(intersection.lat, intersection.lon, "intersection", "",
+                        m_route.arrival_radius[i], m_lastfix.Cog);
+            m_route.set(i, wi);
+            CompileWaypoint(i);
         }
-       
-//        m_current_wp.GUID = "";
-        Recompute();
-        m_Timer.Start(1000/prefs.rate);
     }
 }
 
-void autopilot_route_pi::RearrangeWindow()
+void autopilot_route_pi::CompileRoute()
 {
-    SetColorScheme(PI_ColorScheme());
+    // resolve the guids to their indices in this route once here
+    m_current_wp.index = m_current_wp.GUID.IsEmpty() ? -1 : m_route.find(m_current_wp.GUID, m_route.start);
+    m_last_wpt_activated = m_route.find(m_last_wpt_activated_guid);
+    m_receiver.compile();
 }
 
-void autopilot_route_pi::PositionBearing(double lat0, double lon0, double brg, double dist, double *dlat, double *dlon)
+// recompile after waypoint i was modified
+void autopilot_route_pi::CompileWaypoint(int i)
 {
-    if(prefs.computation == preferences::MERCATOR)
-        PositionBearingDistanceMercator_Plugin(lat0, lon0, brg, dist, dlat, dlon);
-    else
-        ll_gc_ll(lat0, lon0, brg, dist, dlat, dlon);
+    m_last_wpt_activated = m_route.find(m_last_wpt_activated_guid);
+    m_receiver.compile_waypoint(i);
+}
+
+void autopilot_route_pi::RearrangeWindow()
+{
+    SetColorScheme(PI_ColorScheme());
 }
 
 void autopilot_route_pi::DistanceBearing(double lat0, double lon0, double lat1, double lon1, double *brg, double *dist)
@@ -707,45 +1040,18 @@ void autopilot_route_pi::DistanceBearing(double lat0, double lon0, double lat1,
     if(prefs.computation == preferences::MERCATOR)
 //        DistanceBearingMercator_Plugin(lat0, lon0, lat1, lon1, brg, dist);
 // to match Sean 098226d
-        APR_DistanceBearingMercator(lat0, lon0, lat1, lon1, brg, dist);
+        mercator::distance_bearing(lat0, lon0, lat1, lon1, brg, dist);
     else
-        APR_ll_gc_ll_reverse(lat0, lon0, lat1, lon1, brg, dist);
-}
-
-
-wp autopilot_route_pi::Closest(wp &p, wp &p0, wp &p1)
-{
-    if(prefs.computation == preferences::MERCATOR)
-        return computation_mc::closest(p, p0, p1);
-    return computation_gc::closest(p, p0, p1);
-}
-    
-wp autopilot_route_pi::ClosestSeg(wp &p, wp &p0, wp &p1)
-{
-    if(prefs.computation == preferences::MERCATOR)
-        return computation_mc::closest_seg(p, p0, p1);
-    return computation_gc::closest_seg(p, p0, p1);
+        great_circle::distance_bearing(lat0, lon0, lat1, lon1, brg, dist);
 }
 
-double autopilot_route_pi::Distance(wp &p0, wp &p1)
-{
-    if(prefs.computation == preferences::MERCATOR)
-        return computation_mc::distance(p0, p1);
-    return computation_gc::distance(p0, p1);
-}
 
-bool autopilot_route_pi::IntersectCircle(wp &p, double dist, wp &p0, wp &p1, wp &w)
-{
-    if(prefs.computation == preferences::MERCATOR)
-        return computation_mc::intersect_circle(p, dist, p0, p1, w);
-    return computation_gc::intersect_circle(p, dist, p0, p1, w);
-}
-        
-bool autopilot_route_pi::Intersect(wp &p, double brg, wp &p0, wp &p1, wp &w)
+bool autopilot_route_pi::Intersect(wp &p, double brg, int seg, wp &w)
 {
+    wp p0 = m_route.point(seg), p1 = m_route.point(seg+1);
     if(prefs.computation == preferences::MERCATOR)
-        return computation_mc::intersect(p, brg, p0, p1, w);
-    return computation_gc::intersect(p, brg, p0, p1, w);
+        return mercator::intersect(m_route, seg, p, brg, p0, p1, w);
+    return great_circle::intersect(m_route, seg, p, brg, p0, p1, w);
 }
 
 void autopilot_route_pi::RequestRoute(wxString guid)
@@ -757,31 +1063,43 @@ void autopilot_route_pi::RequestRoute(wxString guid)
     SendPluginMessage("OCPN_ROUTE_REQUEST", w.write(v));
 }
 
+// returns true if the waypoint was not advanced
 bool autopilot_route_pi::AdvanceWaypoint()
 {
-    for(ap_route_iterator it=m_route.begin(); it!=m_route.end(); it++) {
-        if(m_current_wp.GUID != it->GUID)
-            continue;
-
-        if(++it == m_route.end()) {
+    // the current waypoint index was resolved when compiling the route
+    int i = m_current_wp.index;
+    if(i >= m_route.start) {
+        if(++i == m_route.size()) {
             // reached destination
-            SendPluginMessage("OCPN_RTE_ENDED", "");
-            break;
-        }
-        if(prefs.confirm_bearing_change) {
-            wxMessageDialog mdlg(GetOCPNCanvasWindow(), _("Advance Waypoint?"),
-                                 _("Autopilot Route"), wxYES | wxNO);
-            if(mdlg.ShowModal() == wxID_NO)
-                break;
-        }
+            PostPluginMessage("OCPN_RTE_ENDED", "");
+        } else {
+            int confirm = CONFIRM_YES;
+            if(prefs.confirm_bearing_change) {
+                // asked on the gui thread, keep steering to this waypoint until answered
+                confirm = m_confirm_advance;
+                // an answer given for another waypoint is asked again
+                if((confirm == CONFIRM_YES || confirm == CONFIRM_NO) &&
+                   m_confirm_wp != m_current_wp.index)
+                    confirm = CONFIRM_NONE;
+                if(confirm == CONFIRM_NONE) {
+                    m_confirm_advance = CONFIRM_PENDING;
+                    m_confirm_wp = m_current_wp.index;
+                    CallAfter(&autopilot_route_pi::ConfirmAdvance);
+                }
+                if(confirm == CONFIRM_NONE || confirm == CONFIRM_PENDING)
+                    return true;
+                m_confirm_advance = CONFIRM_NONE;
+            }
 
-        m_last_wp_name = m_current_wp.name;
-        m_current_wp = *it;
-            
-        return false;
+            if(confirm == CONFIRM_YES) {
+                m_last_wp_name = m_current_wp.name;
+                m_current_wp = m_route.at(i);
+                return false;
+            }
+        }
     }
     // failed to advance waypoint
-    DeactivateRoute();
+    EndRoute();
     return true;
 }
 
@@ -790,19 +1108,26 @@ void autopilot_route_pi::UpdateWaypoint()
     double bearing, dist;
     if(m_current_wp.GUID.IsEmpty()) {
         m_last_wp_name = "---";
-        // activate nearest waypoint
-        double mindist = INFINITY;
-        for(ap_route_iterator it=m_route.begin(); it!=m_route.end(); it++) {
-            APR_ll_gc_ll_reverse(m_lastfix.Lat, m_lastfix.Lon, it->lat, it->lon, 0, &dist);
-            if(dist < mindist) {
-                m_current_wp = *it;
-                mindist = dist;
+        // activate nearest waypoint, the closest point has the largest dot product
+        wp boat(m_lastfix.Lat, m_lastfix.Lon);
+        computation_gc::vector c = computation_gc::ll2v(boat);
+        double maxdot = -INFINITY;
+        int nearest = m_route.start;
+        for(int i=m_route.start; i<m_route.size(); i++) {
+            double d = computation_gc::dot(c, m_route.points[i]);
+            if(d > maxdot) {
+                nearest = i;
+                maxdot = d;
             }
         }
+        m_current_wp = m_route.at(nearest);
     }
 
     APR_ll_gc_ll_reverse(m_lastfix.Lat, m_lastfix.Lon, m_current_wp.lat, m_current_wp.lon,
                      &bearing, &dist);
+    m_solution.wp_bearing = bearing;
+    m_solution.rng = dist;
+    m_solved = true;
 
     // if in the arrival radius, advance
     m_bArrival = dist < m_current_wp.arrival_radius;
@@ -812,25 +1137,29 @@ void autopilot_route_pi::UpdateWaypoint()
             return;
 
         UpdateWaypoint();
+    } else {
+        // left the arrival before advancing, the answer is not kept for the next
+        int confirm = m_confirm_advance;
+        if(confirm == CONFIRM_YES || confirm == CONFIRM_NO)
+            m_confirm_advance.compare_exchange_strong(confirm, CONFIRM_NONE);
     }
 
-    m_next_route_wp_GUID = m_current_wp.GUID; // for total calculations
-    if(m_last_wpt_activated_guid != m_current_wp.GUID) {
+    // compare the interned ids rather than the guid strings
+    int id = m_current_wp.index < 0 ? -1 : m_route.id[m_current_wp.index];
+    if(m_last_wpt_activated != id) {
         Json::FastWriter w;
         Json::Value v;
         v["GUID"] = std::string(m_last_wpt_activated_guid);
-        SendPluginMessage("OCPN_WPT_ACTIVATED", w.write(v));
+        PostPluginMessage("OCPN_WPT_ACTIVATED", w.write(v));
     }
 }
 
-double autopilot_route_pi::FindXTE()
+template<class G> double autopilot_route_pi::FindXTE()
 {
-    // find a position along this bearing
-    double dlat, dlon, brg, xte;
-    PositionBearing(m_current_wp.lat, m_current_wp.lon, m_current_wp.arrival_bearing, 1, &dlat, &dlon);
-    wp b(m_lastfix.Lat, m_lastfix.Lon), w(dlat, dlon);
-    wp p = Closest(b, m_current_wp, w);
-    DistanceBearing(m_lastfix.Lat, m_lastfix.Lon, p.lat, p.lon, &brg, &xte);
+    double brg, xte;
+    wp b(m_lastfix.Lat, m_lastfix.Lon);
+    wp p = G::closest_arrival(m_route, m_current_wp, b);
+    G::distance_bearing(m_lastfix.Lat, m_lastfix.Lon, p.lat, p.lon, &brg, &xte);
 //    if(wxIsNaN(xte))
 //   to match Sean
     if(isnan(xte))
@@ -840,27 +1169,76 @@ double autopilot_route_pi::FindXTE()
     return xte;
 }    
 
-void autopilot_route_pi::ComputeXTE()
+template<class G> void autopilot_route_pi::ComputeXTE()
 {
     UpdateWaypoint();
 
-    double xte = FindXTE();
+    double xte = FindXTE<G>();
     m_current_xte = xte;
     
     m_current_bearing = m_current_wp.arrival_bearing;
     m_current_xte = xte*prefs.xte_multiplier;
 }
 
-void autopilot_route_pi::ComputeWaypointBearing()
+template<class G> void autopilot_route_pi::ComputeWaypointBearing()
 {
     UpdateWaypoint();    
-    DistanceBearing(m_lastfix.Lat, m_lastfix.Lon,
-                    m_current_wp.lat, m_current_wp.lon,
-                    &m_current_bearing, 0);
+    G::distance_bearing(m_lastfix.Lat, m_lastfix.Lon,
+                        m_current_wp.lat, m_current_wp.lon,
+                        &m_current_bearing, 0);
     m_current_xte = 0;
 }
 
-void autopilot_route_pi::ComputeRoutePositionBearing()
+// find the steering position w on segments lo to hi-1, returns the segment
+template<class G> int autopilot_route_pi::SearchRoutePosition(wp &boat, double dist, int lo, int hi, wp &w)
+{
+    // if several segments intersect, the furthest along the route wins
+    int seg = -1;
+    for(int i=lo; i<hi; i++) {
+        wp p0 = m_route.point(i), p1 = m_route.point(i+1), x;
+        if(G::intersect_circle(m_route, i, boat, dist, p0, p1, x)) {
+            seg = i;
+            w = x;
+        }
+    }
+
+    if(seg >= 0)
+        return seg;
+
+    // find closest position in route to boat
+    return G::closest_seg_search(m_route, boat, lo, hi, w);
+}
+
+// same as searching the whole route, using the segment index to
+// only consider segments near the boat
+template<class G> int autopilot_route_pi::SearchRoutePositionIndexed(wp &boat, double dist, wp &w)
+{
+    computation_gc::vector c = G::ll2v(boat);
+    // chord length of the lookahead circle on the unit sphere
+    double chord = 2*sin(dist / 6378137.0 / 2);
+
+    std::vector<int> segs;
+    m_segment_index.within(m_route, c, chord, m_route.start, segs);
+    int seg = -1;
+    for(unsigned int j=0; j<segs.size(); j++) {
+        int i = segs[j];
+        wp p0 = m_route.point(i), p1 = m_route.point(i+1), x;
+        if(G::intersect_circle(m_route, i, boat, dist, p0, p1, x)) {
+            seg = i;
+            w = x;
+        }
+    }
+
+    if(seg >= 0)
+        return seg;
+
+    seg = m_segment_index.nearest(m_route, c, m_route.start);
+    wp p0 = m_route.point(seg), p1 = m_route.point(seg+1);
+    w = G::closest_seg(m_route, seg, boat, p0, p1);
+    return seg;
+}
+
+template<class G> void autopilot_route_pi::ComputeRoutePositionBearing()
 {
     double dist, bearing;
 
@@ -870,63 +1248,55 @@ void autopilot_route_pi::ComputeRoutePositionBearing()
         prefs.route_position_bearing_distance;
 
     // arrival radius only for final route point to deactivate route
-    waypoint &finish = *m_route.rbegin();
+    int last = m_route.size() - 1;
+    wp finish = m_route.point(last);
     double finish_dist;
-    DistanceBearing(m_lastfix.Lat, m_lastfix.Lon, finish.lat, finish.lon,
-                    &bearing, &finish_dist);
+    G::distance_bearing(m_lastfix.Lat, m_lastfix.Lon, finish.lat, finish.lon,
+                        &bearing, &finish_dist);
 
     // if in the arrival radius for final route point or heading away, deactivate
     m_bArrival = finish_dist * 1852.0 < dist;
     if(m_bArrival ||
-       (m_current_wp.eq(finish) && fabs(heading_resolve(finish.arrival_bearing - bearing)) > 90)) {
+       (m_current_wp.eq(finish) &&
+        fabs(heading_resolve(m_route.arrival_bearing[last] - bearing)) > 90)) {
         // reached destination
-        SendPluginMessage("OCPN_RTE_ENDED", "");
-        DeactivateRoute();
+        PostPluginMessage("OCPN_RTE_ENDED", "");
+        EndRoute();
         return;
     }
 
-    wp boat(m_lastfix.Lat, m_lastfix.Lon);
+    wp boat(m_lastfix.Lat, m_lastfix.Lon), w;
     
-    // find optimal position
-    bool havew = false;
-    ap_route_iterator it = m_route.begin();
-    wp p0 = *it, w;
-    for(it++; it!=m_route.end(); it++) {
-        wp p1 = *it;
-        if(IntersectCircle(boat, dist, p0, p1, w)) {
-            havew = true;
-            DistanceBearing(p0.lat, p0.lon, p1.lat, p1.lon,
-                            &m_current_wp.arrival_bearing, 0);
-        }
-        p0 = p1;
+    // find optimal position, only searching near the last position
+    // unless the boat jumped (bad fix or re-route)
+    int seg = -1;
+    if(m_cursor.valid(m_route) && !m_cursor.jumped<G>(boat)) {
+        int lo = wxMax(m_cursor.segment - 1, m_route.start), hi = m_cursor.segment + 2;
+        // extend the window over short segments starting within reach
+        computation_gc::vector c = G::ll2v(boat);
+        double reach = cos((2*dist + route_cursor::jump_distance) / 6378137.0); // earth radius
+        while(hi < last && computation_gc::dot(c, m_route.points[hi]) > reach)
+            hi++;
+        seg = SearchRoutePosition<G>(boat, dist, lo, wxMin(hi, last), w);
     }
 
-    if(!havew) {
-        // find closest position in route to boat
-        it = m_route.begin();
-        p0 = *it;
-        double best_dist = INFINITY;
-        for(it++; it!=m_route.end(); it++) {
-            waypoint p1 = *it;
-            wp x = ClosestSeg(boat, p0, p1);
-            double dist = Distance(boat, x);
-            if(dist <= best_dist) {
-                best_dist = dist;
-                w = x;
-                m_next_route_wp_GUID = p1.GUID; // for total calculations
-                DistanceBearing(p0.lat, p0.lon, p1.lat, p1.lon,
-                                &m_current_wp.arrival_bearing, 0);
-            }
-            p0 = p1;
-        }
+    if(seg < 0) {
+        if(G::indexed)
+            seg = SearchRoutePositionIndexed<G>(boat, dist, w);
+        else
+            seg = SearchRoutePosition<G>(boat, dist, m_route.start, last, w);
     }
 
+    m_cursor.set<G>(m_route, seg, boat, w);
+    m_current_wp.arrival_bearing = m_route.leg_bearing[seg];
+
     // compute bearing from position
     m_current_wp.lat = w.lat;
     m_current_wp.lon = w.lon;
     m_current_wp.GUID = "";
+    m_current_wp.index = -1;
 
-    DistanceBearing(m_lastfix.Lat, m_lastfix.Lon, m_current_wp.lat, m_current_wp.lon, &m_current_bearing, 0);
+    G::distance_bearing(m_lastfix.Lat, m_lastfix.Lon, m_current_wp.lat, m_current_wp.lon, &m_current_bearing, 0);
 
     // clamp to max angle
     double ang = heading_resolve(m_current_bearing - m_current_wp.arrival_bearing);
@@ -940,146 +1310,90 @@ void autopilot_route_pi::ComputeRoutePositionBearing()
     m_current_xte = 0;
 }
 
-void autopilot_route_pi::MagneticHeading(double &val)
+// opens the direct nmea output in the preferences, when it can not be
+// opened the sentences go to opencpn instead.  Opening and stopping can
+// block on the device, so the navigation thread writing sentences is only
+// held off while the output is swapped
+void autopilot_route_pi::SetOutput()
 {
-    val = heading_resolve(val+m_declination, 180);
-}
+    nmea_output *output = NULL;
+    if(prefs.output != nmea_output::OPENCPN) {
+        output = new nmea_output((nmea_output::Type)prefs.output, prefs.output_address);
+        if(!output->Open() || output->Run() != wxTHREAD_NO_ERROR) {
+            wxLogMessage("autopilot_route_pi: nmea output " + output->Error());
+            delete output;
+            output = NULL;
+        }
+    }
 
-NMEA0183    NMEA0183;
+    {
+        wxMutexLocker lock(m_nav_mutex);
+        std::swap(m_output, output);
+    }
 
-void autopilot_route_pi::SendRMB()
+    if(output) {
+        output->Stop();
+        delete output;
+    }
+}
+
+// written directly if configured, otherwise opencpn relays it to its outputs
+void autopilot_route_pi::OutputSentence(nmea_sentence &s)
 {
-    if(!prefs.NmeaSentences("RMB"))
+    const char *sentence = s.finish();
+    if(!sentence)
         return;
+    if(m_output)
+        m_output->Write(sentence);
+    else
+        PushNMEABuffer(wxString::FromAscii(sentence));
+}
 
-    NMEA0183.TalkerID = "EC"; // overrided by opencpn anyway
-
-    SENTENCE snt;
-    NMEA0183.Rmb.IsDataValid = NTrue;
-    NMEA0183.Rmb.CrossTrackError = m_current_xte;
-    NMEA0183.Xte.DirectionToSteer = m_current_xte < 0 ? Left : Right;
-    NMEA0183.Rmb.To = m_current_wp.name.Truncate( 6 );
-    NMEA0183.Rmb.From = m_last_wp_name.Truncate( 6 );
-
-    NMEA0183.Rmb.DestinationPosition.Latitude.Set(
-        fabs(m_current_wp.lat), m_current_wp.lat < 0 ? "S" : "N" );
-    NMEA0183.Rmb.DestinationPosition.Longitude.Set(
-        fabs(m_current_wp.lon), m_current_wp.lon < 0 ? "W" : "E" );
-
-    double brg, dist;
-    DistanceBearing(m_lastfix.Lat, m_lastfix.Lon, m_current_wp.lat, m_current_wp.lon,
-                     &brg, &dist);
-    NMEA0183.Rmb.RangeToDestinationNauticalMiles = dist;
-    NMEA0183.Rmb.BearingToDestinationDegreesTrue = brg;
-    NMEA0183.Rmb.DestinationClosingVelocityKnots = m_lastfix.Sog;
-
-    NMEA0183.Rmb.IsArrivalCircleEntered = m_bArrival ? NTrue : NFalse;
-    NMEA0183.Rmb.Write( snt );
-
-    PushNMEABuffer( snt.Sentence  );
+void autopilot_route_pi::SendRMB()
+{
+    nmea_sentence s = nmea_rmb(m_solution, m_last_wp_name, m_current_wp, m_lastfix.Sog);
+    OutputSentence(s);
 }
 
 void autopilot_route_pi::SendRMC()
 {
-    if(!prefs.NmeaSentences("RMC"))
-        return;
-
-    NMEA0183.TalkerID = "EC"; // overrided by opencpn anyway
-
-    SENTENCE snt;
-    NMEA0183.Rmc.IsDataValid = NTrue;
-
-    double lat = m_lastfix.Lat, lon = m_lastfix.Lon;
-    NMEA0183.Rmc.Position.Latitude.Set( fabs(lat), lat < 0 ? "S" : "N" );
-    NMEA0183.Rmc.Position.Longitude.Set( fabs(lon), lon < 0 ? "W" : "E" );
-
-    NMEA0183.Rmc.SpeedOverGroundKnots = m_lastfix.Sog;
-    NMEA0183.Rmc.TrackMadeGoodDegreesTrue = m_lastfix.Cog;
-
-    if( !isnan(m_lastfix.Var) ) {
-        NMEA0183.Rmc.MagneticVariation = fabs(m_lastfix.Var);
-        NMEA0183.Rmc.MagneticVariationDirection = m_lastfix.Var < 0. ? West : East;
-    } else
-        NMEA0183.Rmc.MagneticVariation = 361.; // A signal to NMEA converter, gVAR is unknown
-
-    wxDateTime now = wxDateTime::Now();
-    wxDateTime utc = now.ToUTC();
-    wxString time = utc.Format( _T("%H%M%S") );
-    NMEA0183.Rmc.UTCTime = time;
-
-    wxString date = utc.Format( _T("%d%m%y") );
-    NMEA0183.Rmc.Date = date;
-
-    NMEA0183.Rmc.Write( snt );
-    PushNMEABuffer( snt.Sentence  );
+    // the time of the fix the position is from, if the fix has one
+    time_t t = m_lastfix.FixTime > 0 ? m_lastfix.FixTime : time(NULL);
+    nmea_sentence s = nmea_rmc(m_rmc_utc, t, m_lastfix.Lat, m_lastfix.Lon,
+                               m_lastfix.Sog, m_lastfix.Cog, m_lastfix.Var);
+    OutputSentence(s);
 }
 
 void autopilot_route_pi::SendAPB()
 {
-    if(!prefs.NmeaSentences("APB"))
-        return;
-    
-    // compute APB sentence
-    NMEA0183.TalkerID = "EC"; // overrided by opencpn anyway
-    NMEA0183.Apb.IsLoranBlinkOK = NTrue;
-    NMEA0183.Apb.IsLoranCCycleLockOK = NTrue;
-    NMEA0183.Apb.CrossTrackErrorMagnitude = fabs(m_current_xte);
-    NMEA0183.Apb.DirectionToSteer = m_current_xte < 0 ? Left : Right;
-    NMEA0183.Apb.CrossTrackUnits = "N";
-    NMEA0183.Apb.IsArrivalCircleEntered = m_bArrival ? NTrue : NFalse;
-
-    //  We never pass the perpendicular, since we declare arrival before reaching this point
-    NMEA0183.Apb.IsPerpendicular = NFalse;
-    NMEA0183.Apb.To = m_current_wp.name.Truncate( 6 );
-
-    NMEA0183.Apb.BearingOriginToDestination = m_current_wp.arrival_bearing;
-
-    double brg;
-    DistanceBearing(m_lastfix.Lat, m_lastfix.Lon, m_current_wp.lat, m_current_wp.lon, &brg, 0);
-    
-    NMEA0183.Apb.BearingPresentPositionToDestination = brg;
-            
-    NMEA0183.Apb.HeadingToSteer = m_current_bearing;
-    if( prefs.magnetic && !isnan(m_declination) ) {
-        NMEA0183.Apb.BearingOriginToDestinationUnits = _T("M");
-        NMEA0183.Apb.BearingPresentPositionToDestinationUnits = _T("M");
-        NMEA0183.Apb.HeadingToSteerUnits = _T("M");
-        
-        MagneticHeading(NMEA0183.Apb.BearingOriginToDestination);
-        MagneticHeading(NMEA0183.Apb.BearingPresentPositionToDestination);
-        MagneticHeading(NMEA0183.Apb.HeadingToSteer);
-    } else {
-        NMEA0183.Apb.BearingOriginToDestinationUnits = _T("T");
-        NMEA0183.Apb.BearingPresentPositionToDestinationUnits = _T("T");
-        NMEA0183.Apb.HeadingToSteerUnits = _T("T");
-    }
-    SENTENCE snt;
-    NMEA0183.Apb.Write( snt );
-    PushNMEABuffer( snt.Sentence );
+    double declination = prefs.magnetic ? m_declination : NAN;
+    nmea_sentence s = nmea_apb(m_solution, m_current_wp.name, declination);
+    OutputSentence(s);
 }
 
 void autopilot_route_pi::SendXTE()
 {
-    if(!prefs.NmeaSentences("XTE"))
-        return;
-    
-    // compute XTE sentence
-    NMEA0183.TalkerID = "EC"; // overrided by opencpn anyway
-            
-    SENTENCE snt;
-    NMEA0183.Xte.IsLoranBlinkOK = NTrue;
-    NMEA0183.Xte.IsLoranCCycleLockOK = NTrue;
-    NMEA0183.Xte.CrossTrackErrorDistance = fabs(m_current_xte);
-    NMEA0183.Xte.DirectionToSteer = m_current_xte < 0 ? Left : Right;
-    NMEA0183.Xte.CrossTrackUnits = _T("N");
-    NMEA0183.Xte.Write( snt );
-    PushNMEABuffer( snt.Sentence  );
+    nmea_sentence s = nmea_xte(m_solution);
+    OutputSentence(s);
 }
 
 void autopilot_route_pi::SendNMEA()
 {
-    SendRMB();
-    SendRMC();
-    SendAPB();
-    SendXTE();
+    // in the order of preferences::NmeaSentence
+    static void (autopilot_route_pi::*const send[])() =
+        { &autopilot_route_pi::SendRMB, &autopilot_route_pi::SendRMC,
+          &autopilot_route_pi::SendAPB, &autopilot_route_pi::SendXTE };
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double slack = .5/prefs.rate;
+    unsigned int mask = prefs.nmea_sentence_mask;
+    for(int i=0; i<preferences::NMEA_SENTENCES; i++) {
+        sentence_schedule &s = m_nmea_schedule[i];
+        if(!(mask & 1<<i) ||
+           !s.due(now, prefs.nmea_rates[i], slack, m_solution, prefs.nmea_on_change,
+                  prefs.nmea_change_bearing, prefs.nmea_change_xte))
+            continue;
+        (this->*send[i])();
+        s.sent(now, m_solution);
+    }
 }
@@ -38,7 +38,6 @@
 
 #define OPC wxS("opencpn-autopilot_route_pi")
 
-#include <list>
 #include <map>
 
 #ifndef WXINTL_NO_GETTEXT_MACRO
@@ -53,6 +52,7 @@
 #endif // WXINTL_NO_GETTEXT_MACRO
 
 #include <stdint.h>
+#include <chrono>
 #include "ocpn_plugin.h"
 
 #ifdef __MSVC__
@@ -67,25 +67,15 @@ class piDC;
 class ConsoleCanvas;
 class PreferencesDialog;
 
-#include "computation.h"
-
-class waypoint : public wp {
-public:
-    waypoint() {}
-    waypoint(double lat, double lon) : wp(lat, lon) {}
-    waypoint(double lat, double lon, wxString name, wxString guid, double ar, double ab);
-
-    wxString name, GUID;
-    double arrival_radius;
-    double arrival_bearing;
-};
-
-typedef std::list<waypoint> ap_route;
-typedef std::list<waypoint>::iterator ap_route_iterator;
+#include "route.h"
+#include "route_receiver.h"
+#include "navigation.h"
+#include "nmea_output.h"
 
 class autopilot_route_pi : public wxEvtHandler, public opencpn_plugin_118
 {
     friend ConsoleCanvas;
+    friend NavigationThread;
 public:
 
     autopilot_route_pi(void *ppimgr);
@@ -117,7 +107,6 @@ public:
 
     static wxString StandardPath();
 
-    PlugIn_Position_Fix_Ex &LastFix() { return m_lastfix; }
     double Declination();
 
     // these are stored to the config
@@ -135,17 +124,19 @@ public:
         double route_position_bearing_max_angle;
 
         // Active Route Window
+        enum ActiveRouteItem { LABEL_XTE, LABEL_BRG, LABEL_RNG, LABEL_TTG, LABEL_VMG,
+                               LABEL_ROUTE_ETA, LABEL_ROUTE_RNG, LABEL_ROUTE_TTG,
+                               LABEL_HIGHWAY, LABEL_WAYPOINTS, LABEL_DEACTIVATE, LABELS };
+        static const char *const active_route_label_names[LABELS];
         std::map<wxString, bool> active_route_labels[2];
-        bool ActiveRouteLabel(int i, wxString label) {
-            if(active_route_labels[i].find(label) != active_route_labels[i].end())
-                return active_route_labels[i][label];
-            return false;
+        bool ActiveRouteLabel(int i, ActiveRouteItem label) const {
+            return active_route_label_mask[i] & 1<<label;
         }
 
         // Waypoint Arrival
         bool confirm_bearing_change;
         bool intercept_route;
-        enum ComputationType { GREAT_CIRCLE, MERCATOR } computation;
+        enum ComputationType { GREAT_CIRCLE, MERCATOR, GREAT_CIRCLE_FAST } computation;
 
         // Boundary
         wxString boundary_guid;
@@ -154,28 +145,62 @@ public:
         // NMEA output
         int rate;
         bool magnetic;
+        bool fix_triggered; // compute on each fix instead of at the rate
+        bool predict;       // dead reckon from the last fix between fixes
+        enum NmeaSentence { NMEA_RMB, NMEA_RMC, NMEA_APB, NMEA_XTE, NMEA_SENTENCES };
+        static const char *const nmea_sentence_names[NMEA_SENTENCES];
         std::map<wxString, bool> nmea_sentences;
-        bool NmeaSentences(wxString sentence) {
-            if(nmea_sentences.find(sentence) != nmea_sentences.end())
-                return nmea_sentences[sentence];
-            return false;
+        double nmea_rates[NMEA_SENTENCES]; // Hz, 0 sends at every update
+        // also send as soon as the steering changes this much, the rates
+        // then only keep the sentences alive
+        bool nmea_on_change;
+        double nmea_change_bearing, nmea_change_xte; // degrees, nautical miles
+        int output;             // nmea_output::Type, OPENCPN to push to opencpn
+        wxString output_address;
+        bool NmeaSentences(NmeaSentence sentence) const {
+            return nmea_sentence_mask & 1<<sentence;
         }
+
+        // the label and sentence maps as bits, so checking them on each
+        // update or redraw is a bit test instead of string lookups, and
+        // the mode made valid; called with the navigation mutex held
+        void Compile();
+        unsigned int active_route_label_mask[2];
+        unsigned int nmea_sentence_mask;
     } prefs;
 
+    // held while changing the route, preferences or other state the
+    // navigation thread reads
+    wxMutex m_nav_mutex;
+
     // for console canvas
-    bool GetConsoleInfo(double &sog, double &cog, double &bearing, double &xte,
-                        double *rng, double *nrng);
+    const nav_state &NavState();
     void DeactivateRoute();
+    void SetComputation();
+    void SetOutput();
+    void CompileRoute();
+    void CompileWaypoint(int i);
+    void WakeNavigation() { if(m_nav_thread) m_nav_thread->Wake(); }
 protected:
     void Render(piDC &dc, PlugIn_ViewPort &vp);
-    void RenderArrivalWaypoint(piDC &dc, PlugIn_ViewPort &vp);
-    void RenderRoutePositionBearing(piDC &dc, PlugIn_ViewPort &vp);
+    void RenderArrivalWaypoint(piDC &dc, PlugIn_ViewPort &vp, const waypoint &w);
+    void RenderRoutePositionBearing(piDC &dc, PlugIn_ViewPort &vp, const waypoint &w);
     void OnTimer( wxTimerEvent & );
 
     wxPoint m_cursor_position;
     PlugIn_Position_Fix_Ex m_lastfix;
 
 private:
+    // on the navigation thread
+    int Navigate(bool force);
+    void Solve();
+    void Publish();
+    void PostPluginMessage(const wxString &message_id, const wxString &message_body);
+    void EndRoute();
+    void ConfirmAdvance();
+    int NextWaypoint();
+    double Remaining();
+
     void Recompute();
     void SetCursorLatLon(double lat, double lon);
     void SetNMEASentence(wxString &sentence);
@@ -184,34 +209,64 @@ private:
 
     void RearrangeWindow();
 
-    void PositionBearing(double lat0, double lon0, double brg, double dist, double *dlat, double *dlon);
     void DistanceBearing(double lat0, double lon0, double lat1, double lon1, double *bearing, double *dist);
 
-    wp Closest(wp &p, wp &p0, wp &p1);
-    wp ClosestSeg(wp &p, wp &p0, wp &p1);
-    double Distance(wp &p0, wp &p1);
-    bool IntersectCircle(wp &p, double dist, wp &p0, wp &p1, wp &w);
-    bool Intersect(wp &p, double bearing, wp &p0, wp &p1, wp &w);
-    
+    bool Intersect(wp &p, double bearing, int seg, wp &w);
+
     void RequestRoute(wxString guid);
+    void StartRoute(wp &boat);
     bool AdvanceWaypoint();
     void UpdateWaypoint();
-    double FindXTE();
-    void ComputeXTE();
+    template<class G> double FindXTE();
+    template<class G> void ComputeXTE();
     void ComputeBoundaryXTE();
-    void ComputeWaypointBearing();
-    void ComputeRoutePositionBearing();
-    void MagneticHeading(double &val);
+    template<class G> void ComputeWaypointBearing();
+    template<class G> int SearchRoutePosition(wp &boat, double dist, int lo, int hi, wp &w);
+    template<class G> int SearchRoutePositionIndexed(wp &boat, double dist, wp &w);
+    template<class G> void ComputeRoutePositionBearing();
+
+    // navigation computations instantiated for one geometry (see geometry.h)
+    struct engine
+    {
+        void (autopilot_route_pi::*ComputeXTE)();
+        void (autopilot_route_pi::*ComputeWaypointBearing)();
+        void (autopilot_route_pi::*ComputeRoutePositionBearing)();
+    };
+    template<class G> static const engine *Engine();
+    template<class G> static route_geometry Geometry();
+    const engine *m_engine;
 
     void SendRMB();
     void SendRMC();
     void SendAPB();
     void SendXTE();
     void SendNMEA();
+    void OutputSentence(nmea_sentence &s);
+    void UpdateETA();
+    void SendETA();
+    void SendLatency();
 
     int m_leftclick_tool_id;
     wxTimer m_Timer;
 
+    NavigationThread *m_nav_thread;
+    nmea_output *m_output; // written directly, pushed to opencpn when NULL
+    struct received_fix
+    {
+        PlugIn_Position_Fix_Ex fix;
+        std::chrono::steady_clock::time_point time;
+    };
+    latest<received_fix> m_fix_mailbox;
+    latency_stats m_latency;
+    dead_reckoning m_dead_reckoning;
+    sentence_schedule m_nmea_schedule[preferences::NMEA_SENTENCES];
+    utc_fields m_rmc_utc;
+    latest<nav_state> m_nav_state;
+    bool m_route_ended; // by the navigation thread, until deactivated
+    enum { CONFIRM_NONE, CONFIRM_PENDING, CONFIRM_YES, CONFIRM_NO };
+    std::atomic<int> m_confirm_advance;
+    int m_confirm_wp; // route index the confirmation was asked for
+
     double m_declination;
     wxDateTime m_declinationTime;
 
@@ -221,17 +276,27 @@ private:
     PI_ColorScheme m_colorscheme;
 
     wxString m_active_guid, m_active_request_guid;
-    wxDateTime m_active_request_time;
+    route_refresh m_refresh;
+    // changed on the gui thread and its mercator frame re-anchored on
+    // either thread, all with m_nav_mutex held, so the gui reads it with
+    // the mutex held too
     ap_route m_route;
+    route_cursor m_cursor;
+    eta_schedule m_eta;
+    segment_index m_segment_index; // built on first use after compiling
+    route_receiver m_receiver;     // compiles m_route as received
 
     waypoint m_current_wp;
-    wxString m_next_route_wp_GUID;
     wxString m_last_wp_name, m_last_wpt_activated_guid;
+    int m_last_wpt_activated; // interned id of m_last_wpt_activated_guid
 
     bool m_bArrival;
 
     double m_current_bearing, m_current_xte;
 
+    nav_solution m_solution;
+    bool m_solved; // m_solution has the range and bearing to m_current_wp
+
     // optimum route mode variables
     double m_avg_sog;
 };
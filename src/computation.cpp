@@ -25,8 +25,19 @@
  */
 
 #include <math.h>
+#include <algorithm>
 #include "computation.h"
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define CLOSEST_SEG_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CLOSEST_SEG_AVX2
+#include <immintrin.h>
+#endif
+
 #ifndef M_PI
       #define M_PI        3.1415926535897931160E0      /* pi */
 #endif
@@ -38,162 +49,436 @@ double rad2deg(double x) { return x * 180 / M_PI; }
 namespace computation_gc
 {
 
-struct vector
-{
-    vector() {}
-    vector(double _x, double _y, double _z) : x(_x), y(_y), z(_z) {}
-    double norm() { return sqrt(x*x + y*y + z*z); }
-    void normalize() { double n = norm(); x/=n, y/=n, z/=n; }
-    double x, y, z;
-};
+double vector::norm() { return sqrt(x*x + y*y + z*z); }
+void vector::normalize() { double n = norm(); x/=n, y/=n, z/=n; }
 
 vector cross(vector &a, vector &b) { return vector(a.y*b.z - a.z*b.y,
                                                    a.z*b.x - a.x*b.z,
                                                    a.x*b.y - a.y*b.x); }
 double dot(vector &a, vector &b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
 
-struct quaternion
+// Rodrigues' rotation formula, v*c + (k x v)*s + k*(k.v)*(1 - c)
+vector rotate(vector &v, vector &k, double s, double c)
 {
-    quaternion(double angle, vector &v) {
-        double n = v.norm(), fac;
-        if(n == 0)
-            fac = 0;
-        else
-            fac = sin(angle/2) / n;
-        r = cos(angle/2), i = v.x*fac, j = v.y*fac, k = v.z*fac;
-    }
-    quaternion operator*(const quaternion &q) {
-        return quaternion(r*q.r - i*q.i - j*q.j - k*q.k,
-                          r*q.i + i*q.r + j*q.k - k*q.j,
-                          r*q.j - i*q.k + j*q.r + k*q.i,
-                          r*q.k + i*q.j - j*q.i + k*q.r);
-    }
+    vector kv = cross(k, v);
+    double f = dot(k, v)*(1 - c);
+    return vector(v.x*c + kv.x*s + k.x*f,
+                  v.y*c + kv.y*s + k.y*f,
+                  v.z*c + kv.z*s + k.z*f);
+}
 
-    quaternion conjugate() { return quaternion(r, -i, -j, -k); }
+// trig the great circle computations are instantiated with
+struct libm_trig
+{
+    static double sin(double x) { return ::sin(x); }
+    static double cos(double x) { return ::cos(x); }
+    static double asin(double x) { return ::asin(x); }
+    static double acos(double x) { return ::acos(x); }
+    static double atan2(double y, double x) { return ::atan2(y, x); }
+};
 
-    vector rotate(vector &v) {
-        quaternion w(0, v.x, v.y, v.z);
-        quaternion r = *this*w*conjugate();
-        return vector(r.i, r.j, r.k);
+/* polynomial approximations without the libm argument handling.  sin and
+   cos are reduced to +-pi/4 and carried to the x^15 and x^16 terms, so
+   within 1.2e-16: ll2v must give unit vectors as acos of a dot product
+   near 1 magnifies any error in their length.  atan2, asin and acos are
+   reduced to |u| <= tan(pi/12) and use the odd series to u^15, within
+   1.1e-11 radians.  Positions from v2ll, closest, closest_seg and
+   intersect_circle then agree with libm to within 0.1mm (9e-5 m worst
+   over a million random positions worldwide). */
+struct fast_trig
+{
+    static void sincos(double x, double &s, double &c) {
+        // x = r + k*pi/2 with pi/2 split in two so r stays exact
+        const double pio2_hi = 1.57079632673412561417e+00;
+        const double pio2_lo = 6.07710050650619224932e-11;
+        double k = floor(x * (2/M_PI) + 0.5);
+        double r = (x - k*pio2_hi) - k*pio2_lo, r2 = r*r;
+
+        double sr = r + r*r2*(-1/6.0 + r2*(1/120.0 + r2*(-1/5040.0 + r2*(1/362880.0
+                    + r2*(-1/39916800.0 + r2*(1/6227020800.0 + r2*(-1/1307674368000.0)))))));
+        double cr = 1 + r2*(-1/2.0 + r2*(1/24.0 + r2*(-1/720.0 + r2*(1/40320.0
+                    + r2*(-1/3628800.0 + r2*(1/479001600.0 + r2*(-1/87178291200.0
+                    + r2*(1/20922789888000.0))))))));
+        switch((long)k & 3) {
+        case 0: s = sr, c = cr; break;
+        case 1: s = cr, c = -sr; break;
+        case 2: s = -sr, c = -cr; break;
+        default: s = -cr, c = sr;
+        }
     }
-
-private:
-    quaternion(double _r, double _i, double _j, double _k) : r(_r), i(_i), j(_j), k(_k) {}
-    double r, i, j, k;
+    static double sin(double x) { double s, c; sincos(x, s, c); return s; }
+    static double cos(double x) { double s, c; sincos(x, s, c); return c; }
+
+    // atan of 0 <= t <= 1
+    static double atan_unit(double t) {
+        const double sqrt3 = 1.73205080756887729353, tan_pi_12 = 0.26794919243112270647;
+        double a = 0;
+        if(t > tan_pi_12) {
+            // atan(t) = pi/6 + atan((t*sqrt(3) - 1) / (sqrt(3) + t))
+            a = M_PI/6;
+            t = (t*sqrt3 - 1) / (sqrt3 + t);
+        }
+        double t2 = t*t;
+        return a + t + t*t2*(-1/3.0 + t2*(1/5.0 + t2*(-1/7.0 + t2*(1/9.0 + t2*(-1/11.0
+                                                              + t2*(1/13.0 + t2*(-1/15.0)))))));
+    }
+    static double atan2(double y, double x) {
+        double ax = fabs(x), ay = fabs(y), a;
+        if(ay <= ax)
+            a = ax == 0 ? 0 : atan_unit(ay/ax);
+        else
+            a = M_PI/2 - atan_unit(ax/ay);
+        if(x < 0)
+            a = M_PI - a;
+        return y < 0 ? -a : a;
+    }
+    // (1-x)*(1+x) keeps precision near +-1, clamped for rounding past it
+    static double asin(double x) { return atan2(x, sqrt(std::max((1-x)*(1+x), 0.0))); }
+    static double acos(double x) { return atan2(sqrt(std::max((1-x)*(1+x), 0.0)), x); }
 };
 
-
 const double earth_radius_meters       = 6378137.0;
 double m2rad(double x) { return x/earth_radius_meters; }
 
-vector ll2v(wp &p)
+template<class T> static vector ll2v_t(wp &p)
 {
-    double lat = deg2rad(p.lat), lon = deg2rad(p.lon);
-    return vector(cos(lat)*sin(lon), cos(lat)*cos(lon), sin(lat));
+    double lat = deg2rad(p.lat), lon = deg2rad(p.lon), coslat = T::cos(lat);
+    return vector(coslat*T::sin(lon), coslat*T::cos(lon), T::sin(lat));
 }
 
-wp v2ll(vector a)
+template<class T> static wp v2ll_t(vector a)
 {
-    return wp(rad2deg(asin(a.z)), rad2deg(atan2(a.x, a.y)));
+    return wp(rad2deg(T::asin(a.z)), rad2deg(T::atan2(a.x, a.y)));
 }
 
-// find closest vector to c on great circle defined by v0 and v1
-vector closest_vector_n(vector &c, vector &v0, vector &v1, vector &n)
+vector ll2v(wp &p) { return ll2v_t<libm_trig>(p); }
+wp v2ll(vector a) { return v2ll_t<libm_trig>(a); }
+
+segment::segment(vector &_v0, vector &_v1)
+    : v0(_v0), v1(_v1), n(cross(_v0, _v1)), d(dot(_v0, _v1))
 {
-    n = cross(v0, v1);
     n.normalize();
+}
+
+// find closest vector to c on great circle with normal n
+vector closest_vector(vector &c, vector &n)
+{
     vector m = cross(n, c);
     m.normalize();
     return cross(m, n);
 }
 
-vector closest_vector(vector &c, vector &v0, vector &v1)
+// find closest vector to c on great circle segment s
+vector closest_vector_seg(vector &c, segment &s)
 {
-    vector n;
-    return closest_vector_n(c, v0, v1, n);
+    vector v = closest_vector(c, s.n);
+    double d1 = dot(v, s.v0), d2 = dot(v, s.v1);
+    if(d1 > s.d && d2 > s.d)
+        return v;
+    if(d1 > d2)
+        return s.v0;
+    return s.v1;
 }
 
 // find position closest to p, on great circle defined by p0 and p1
 wp closest(wp &p, wp &p0, wp &p1)
 {
-    vector v = ll2v(p), v0 = ll2v(p0), v1 = ll2v(p1);
-    return v2ll(closest_vector(v, v0, v1));
+    vector v0 = ll2v(p0), v1 = ll2v(p1);
+    segment s(v0, v1);
+    return closest(p, s.n);
+}
+
+// find position closest to p, on great circle with normal n
+template<class T> static wp closest_t(wp &p, vector &n)
+{
+    vector c = ll2v_t<T>(p);
+    return v2ll_t<T>(closest_vector(c, n));
 }
 
+wp closest(wp &p, vector &n) { return closest_t<libm_trig>(p, n); }
+
 // find position closest to p, on great circle segment defined by p0 and p1
 wp closest_seg(wp &p, wp &p0, wp &p1)
 {
-    vector c = ll2v(p), v0 = ll2v(p0), v1 = ll2v(p1);
-    vector v = closest_vector(c, v0, v1);
-    double d0 = dot(v0, v1), d1 = dot(v, v0), d2 = dot(v, v1);
-    if(d1 > d0 && d2 > d0)
-        return v2ll(v);
+    vector v0 = ll2v(p0), v1 = ll2v(p1);
+    segment s(v0, v1);
+    return closest_seg(p, p0, p1, s);
+}
+
+template<class T> static wp closest_seg_t(wp &p, wp &p0, wp &p1, segment &s)
+{
+    vector c = ll2v_t<T>(p);
+    vector v = closest_vector(c, s.n);
+    double d1 = dot(v, s.v0), d2 = dot(v, s.v1);
+    if(d1 > s.d && d2 > s.d)
+        return v2ll_t<T>(v);
     if(d1 > d2)
         return p0;
     return p1;
 }
 
+wp closest_seg(wp &p, wp &p0, wp &p1, segment &s) { return closest_seg_t<libm_trig>(p, p0, p1, s); }
+
+void segment_array::resize(int points)
+{
+    int segments = points > 0 ? points - 1 : 0;
+    px.resize(points), py.resize(points), pz.resize(points);
+    nx.resize(segments), ny.resize(segments), nz.resize(segments), d.resize(segments);
+}
+
+void segment_array::set_point(int i, vector &v)
+{
+    px[i] = v.x, py[i] = v.y, pz[i] = v.z;
+}
+
+void segment_array::set_segment(int i, segment &s)
+{
+    nx[i] = s.n.x, ny[i] = s.n.y, nz[i] = s.n.z, d[i] = s.d;
+}
+
+/* The closest vector to c on the great circle with normal n is
+   v = (c - (c.n)n)/l where l = |c - (c.n)n| = sqrt(1 - (c.n)^2) = c.v
+   It is on the segment if v.v0 > d and v.v1 > d, and since n is
+   perpendicular to v0 and v1 this is c.v0 > d*l and c.v1 > d*l.
+   Otherwise the closest position is the nearer end point, so the score
+   c.v (larger is closer) is max(c.v0, c.v1). */
+static void closest_seg_batch_scalar(vector &c, segment_array &a, int lo, int hi,
+                                     double &best, int &best_i)
+{
+    for(int i=lo; i<hi; i++) {
+        double cn = c.x*a.nx[i] + c.y*a.ny[i] + c.z*a.nz[i];
+        double l = sqrt(std::max(1 - cn*cn, 0.0));
+        double c0 = c.x*a.px[i] + c.y*a.py[i] + c.z*a.pz[i];
+        double c1 = c.x*a.px[i+1] + c.y*a.py[i+1] + c.z*a.pz[i+1];
+        double dl = a.d[i]*l;
+        double score = c0 > dl && c1 > dl ? l : std::max(c0, c1);
+        if(score >= best) {
+            best = score;
+            best_i = i;
+        }
+    }
+}
+
+// combine the per lane results, later segments win ties
+static void closest_seg_batch_reduce(double *score, double *index, int lanes,
+                                     double &best, int &best_i)
+{
+    for(int j=0; j<lanes; j++)
+        if(index[j] >= 0 && (score[j] > best || (score[j] == best && index[j] > best_i))) {
+            best = score[j];
+            best_i = (int)index[j];
+        }
+}
+
+#ifdef CLOSEST_SEG_SSE2
+static int closest_seg_batch_sse2(vector &c, segment_array &a, int lo, int hi)
+{
+    __m128d cx = _mm_set1_pd(c.x), cy = _mm_set1_pd(c.y), cz = _mm_set1_pd(c.z);
+    __m128d one = _mm_set1_pd(1), zero = _mm_setzero_pd(), two = _mm_set1_pd(2);
+    __m128d best = _mm_set1_pd(-INFINITY), best_i = _mm_set1_pd(-1);
+    __m128d index = _mm_setr_pd(lo, lo+1);
+
+    int i = lo;
+    for(; i+2 <= hi; i+=2) {
+        __m128d cn = _mm_add_pd(_mm_add_pd(_mm_mul_pd(cx, _mm_loadu_pd(&a.nx[i])),
+                                           _mm_mul_pd(cy, _mm_loadu_pd(&a.ny[i]))),
+                                _mm_mul_pd(cz, _mm_loadu_pd(&a.nz[i])));
+        __m128d l = _mm_sqrt_pd(_mm_max_pd(_mm_sub_pd(one, _mm_mul_pd(cn, cn)), zero));
+        __m128d c0 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(cx, _mm_loadu_pd(&a.px[i])),
+                                           _mm_mul_pd(cy, _mm_loadu_pd(&a.py[i]))),
+                                _mm_mul_pd(cz, _mm_loadu_pd(&a.pz[i])));
+        __m128d c1 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(cx, _mm_loadu_pd(&a.px[i+1])),
+                                           _mm_mul_pd(cy, _mm_loadu_pd(&a.py[i+1]))),
+                                _mm_mul_pd(cz, _mm_loadu_pd(&a.pz[i+1])));
+        __m128d dl = _mm_mul_pd(_mm_loadu_pd(&a.d[i]), l);
+        __m128d inside = _mm_and_pd(_mm_cmpgt_pd(c0, dl), _mm_cmpgt_pd(c1, dl));
+        __m128d score = _mm_or_pd(_mm_and_pd(inside, l),
+                                  _mm_andnot_pd(inside, _mm_max_pd(c0, c1)));
+        __m128d better = _mm_cmpge_pd(score, best);
+        best = _mm_or_pd(_mm_and_pd(better, score), _mm_andnot_pd(better, best));
+        best_i = _mm_or_pd(_mm_and_pd(better, index), _mm_andnot_pd(better, best_i));
+        index = _mm_add_pd(index, two);
+    }
+
+    double s[2], idx[2], b = -INFINITY;
+    int b_i = -1;
+    _mm_storeu_pd(s, best);
+    _mm_storeu_pd(idx, best_i);
+    closest_seg_batch_reduce(s, idx, 2, b, b_i);
+    closest_seg_batch_scalar(c, a, i, hi, b, b_i);
+    return b_i;
+}
+#endif
+
+#ifdef CLOSEST_SEG_AVX2
+__attribute__((target("avx2")))
+static int closest_seg_batch_avx2(vector &c, segment_array &a, int lo, int hi)
+{
+    __m256d cx = _mm256_set1_pd(c.x), cy = _mm256_set1_pd(c.y), cz = _mm256_set1_pd(c.z);
+    __m256d one = _mm256_set1_pd(1), zero = _mm256_setzero_pd(), four = _mm256_set1_pd(4);
+    __m256d best = _mm256_set1_pd(-INFINITY), best_i = _mm256_set1_pd(-1);
+    __m256d index = _mm256_setr_pd(lo, lo+1, lo+2, lo+3);
+
+    int i = lo;
+    for(; i+4 <= hi; i+=4) {
+        __m256d cn = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(cx, _mm256_loadu_pd(&a.nx[i])),
+                                                 _mm256_mul_pd(cy, _mm256_loadu_pd(&a.ny[i]))),
+                                   _mm256_mul_pd(cz, _mm256_loadu_pd(&a.nz[i])));
+        __m256d l = _mm256_sqrt_pd(_mm256_max_pd(_mm256_sub_pd(one, _mm256_mul_pd(cn, cn)), zero));
+        __m256d c0 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(cx, _mm256_loadu_pd(&a.px[i])),
+                                                 _mm256_mul_pd(cy, _mm256_loadu_pd(&a.py[i]))),
+                                   _mm256_mul_pd(cz, _mm256_loadu_pd(&a.pz[i])));
+        __m256d c1 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(cx, _mm256_loadu_pd(&a.px[i+1])),
+                                                 _mm256_mul_pd(cy, _mm256_loadu_pd(&a.py[i+1]))),
+                                   _mm256_mul_pd(cz, _mm256_loadu_pd(&a.pz[i+1])));
+        __m256d dl = _mm256_mul_pd(_mm256_loadu_pd(&a.d[i]), l);
+        __m256d inside = _mm256_and_pd(_mm256_cmp_pd(c0, dl, _CMP_GT_OQ),
+                                       _mm256_cmp_pd(c1, dl, _CMP_GT_OQ));
+        __m256d score = _mm256_blendv_pd(_mm256_max_pd(c0, c1), l, inside);
+        __m256d better = _mm256_cmp_pd(score, best, _CMP_GE_OQ);
+        best = _mm256_blendv_pd(best, score, better);
+        best_i = _mm256_blendv_pd(best_i, index, better);
+        index = _mm256_add_pd(index, four);
+    }
+
+    double s[4], idx[4], b = -INFINITY;
+    int b_i = -1;
+    _mm256_storeu_pd(s, best);
+    _mm256_storeu_pd(idx, best_i);
+    closest_seg_batch_reduce(s, idx, 4, b, b_i);
+    closest_seg_batch_scalar(c, a, i, hi, b, b_i);
+    return b_i;
+}
+#endif
+
+static int closest_seg_batch_generic(vector &c, segment_array &a, int lo, int hi)
+{
+    double best = -INFINITY;
+    int best_i = -1;
+    closest_seg_batch_scalar(c, a, lo, hi, best, best_i);
+    return best_i;
+}
+
+typedef int (*closest_seg_batch_fn)(vector &c, segment_array &a, int lo, int hi);
+
+static closest_seg_batch_fn select_closest_seg_batch()
+{
+#ifdef CLOSEST_SEG_AVX2
+    if(__builtin_cpu_supports("avx2"))
+        return closest_seg_batch_avx2;
+#endif
+#ifdef CLOSEST_SEG_SSE2
+    return closest_seg_batch_sse2;
+#endif
+    return closest_seg_batch_generic;
+}
+
+int closest_seg_batch(vector &c, segment_array &a, int lo, int hi)
+{
+    static closest_seg_batch_fn fn = select_closest_seg_batch();
+    return fn(c, a, lo, hi);
+}
+
 // find distance in radians between two positions
-double distance(wp &p0, wp &p1)
+template<class T> static double distance_t(wp &p0, wp &p1)
 {
-    vector v0 = ll2v(p0), v1 = ll2v(p1);
-    return acos(dot(v0, v1));
+    vector v0 = ll2v_t<T>(p0), v1 = ll2v_t<T>(p1);
+    return T::acos(dot(v0, v1));
 }
 
+double distance(wp &p0, wp &p1) { return distance_t<libm_trig>(p0, p1); }
+
 // set w to the intersection of (position p, radius r) on great circle
 // segment defined by p0 and p1 if circle intersects segment twice,
 // return position closest to p1
 bool intersect_circle(wp &p, double dist, wp &p0, wp &p1, wp &w)
 {
-    double r = m2rad(dist);
-    vector c = ll2v(p), v0 = ll2v(p0), v1 = ll2v(p1), n;
-    vector v = closest_vector_n(c, v0, v1, n);
+    vector v0 = ll2v(p0), v1 = ll2v(p1);
+    segment s(v0, v1);
+    return intersect_circle(p, dist, s, w);
+}
 
-    double a = dot(c, v), d = cos(r);
-    if(a < d)
+template<class T> static bool intersect_circle_t(wp &p, double dist, segment &s, wp &w)
+{
+    double r = m2rad(dist);
+    vector c = ll2v_t<T>(p);
+    vector v = closest_vector(c, s.n);
+
+    // a = cos(x), x the distance from p to the great circle, and d = cos(r).
+    // For small circles a - d is the difference of two numbers near one,
+    // so it is taken from the half angles as 2*sin(r/2)^2 - 2*sin(x/2)^2
+    double a = dot(c, v), sx = dot(c, s.n), h = T::sin(r/2);
+    double d = 1 - 2*h*h, ad = 2*h*h - sx*sx/(1 + a);
+    if(ad < 0)
         return false; // spherical circle doesn't intersect great circle
 
     // spherical law of cosines, b is distance from closest position
-    // to where spherical circle intersects p0<->p1
-    double b = acos(d/a);
-    quaternion q(b, n);
-    vector w0 = q.rotate(v), w1 = q.conjugate().rotate(v);
+    // to where spherical circle intersects p0<->p1.  v and n x v are
+    // perpendicular to n so the intersections are v*cos(b) +- (n x v)*sin(b)
+    double cb = d/a, sb = sqrt(std::max(ad*(a + d), 0.0))/a;
+    vector u = cross(s.n, v);
+    vector w0(v.x*cb + u.x*sb, v.y*cb + u.y*sb, v.z*cb + u.z*sb);
+    vector w1(v.x*cb - u.x*sb, v.y*cb - u.y*sb, v.z*cb - u.z*sb);
 
     // ensure great circle intersections fall between p0 and p1
-    d = dot(v0, v1);
-    bool bp0 = dot(w0, v0) > d && dot(w0, v1) > d;
-    bool bp1 = dot(w1, v0) > d && dot(w1, v1) > d;
+    d = s.d;
+    bool bp0 = dot(w0, s.v0) > d && dot(w0, s.v1) > d;
+    bool bp1 = dot(w1, s.v0) > d && dot(w1, s.v1) > d;
     // if both valid, return position closest to p1
-    if(bp0 && (!bp1 || dot(w0, v1) > dot(w1, v1))) {
-        w = v2ll(w0);
+    if(bp0 && (!bp1 || dot(w0, s.v1) > dot(w1, s.v1))) {
+        w = v2ll_t<T>(w0);
         return true;
     } else if(bp1) {
-        w = v2ll(w1);
+        w = v2ll_t<T>(w1);
         return true;
     }
     return false;
 }
 
+bool intersect_circle(wp &p, double dist, segment &s, wp &w)
+{
+    return intersect_circle_t<libm_trig>(p, dist, s, w);
+}
+
 // set w to the intersection of great circle with (position p, brg)
 // on great circle p0 and p1
 bool intersect(wp &p, double brg, wp &p0, wp &p1, wp &w)
+{
+    vector v0 = ll2v(p0), v1 = ll2v(p1);
+    segment s(v0, v1);
+    return intersect(p, brg, s, w);
+}
+
+bool intersect(wp &p, double brg, segment &s, wp &w)
 {
     vector north(0, 0, 1), c = ll2v(p);
-    quaternion q(brg, c);
-    vector b = q.rotate(north);
+    vector b = rotate(north, c, sin(brg), cos(brg));
     vector m = cross(c, b);
     m.normalize(); // m is plane of p at brg
 
-    vector v0 = ll2v(p0), v1 = ll2v(p1);
-    vector n = cross(v0, v1);
-    n.normalize(); // n is plane of p0 and p1
-
-    vector i = cross(n, m); // intersection is w
+    vector i = cross(s.n, m); // intersection is w
     w = v2ll(i);
 
     // ensure w falls on the segment between p0 and p1
-    double d = dot(v0, v1);
-    return dot(i, v0) > d && dot(i, v1) > d;
+    return dot(i, s.v0) > s.d && dot(i, s.v1) > s.d;
+}
+
+}
+
+// the same great circle computations with the polynomial trig
+namespace computation_gc_fast
+{
+
+using namespace computation_gc;
+
+vector ll2v(wp &p) { return ll2v_t<fast_trig>(p); }
+wp v2ll(vector a) { return v2ll_t<fast_trig>(a); }
+double distance(wp &p0, wp &p1) { return distance_t<fast_trig>(p0, p1); }
+wp closest(wp &p, vector &n) { return closest_t<fast_trig>(p, n); }
+wp closest_seg(wp &p, wp &p0, wp &p1, segment &s) { return closest_seg_t<fast_trig>(p, p0, p1, s); }
+bool intersect_circle(wp &p, double dist, segment &s, wp &w)
+{
+    return intersect_circle_t<fast_trig>(p, dist, s, w);
 }
 
 }
@@ -204,11 +489,45 @@ namespace computation_mc
 
 #include "georef.h"
 
-wp closest_a(wp &p, wp &p0, wp &p1, double &a)
+const double frame::drift = 1;
+
+static double mercator_y(double lat)
+{
+    // y =.5 ln( (1 + sin t) / (1 - sin t) )
+    double s = sin(deg2rad(lat));
+    return .5 * log((1 + s) / (1 - s)) * WGS84_semimajor_axis_meters * mercator_k0;
+}
+
+void frame::anchor(wp &a)
 {
-    double p0x, p0y, p1x, p1y;
-    toSM(p0.lat, p0.lon, p.lat, p.lon, &p0x, &p0y);
-    toSM(p1.lat, p1.lon, p.lat, p.lon, &p1x, &p1y);
+    origin = a;
+    y0 = mercator_y(a.lat);
+    valid = true;
+}
+
+bool frame::drifted(wp &p)
+{
+    double dlon = fabs(p.lon - origin.lon);
+    return fabs(p.lat - origin.lat) > drift || (dlon > drift && dlon < 360 - drift);
+}
+
+// same as toSM around the origin
+xy frame::project(wp &p)
+{
+    double lon = p.lon;
+    // make sure lon and the origin are same phase
+    if(lon * origin.lon < 0 && fabs(lon - origin.lon) > 180)
+        lon += lon < 0 ? 360 : -360;
+    return xy(deg2rad(lon - origin.lon) * WGS84_semimajor_axis_meters * mercator_k0,
+              mercator_y(p.lat) - y0);
+}
+
+wp frame::unproject(xy &v)
+{
+    wp p;
+    fromSM(v.x, v.y, origin.lat, origin.lon, &p.lat, &p.lon);
+    return p;
+}
 
 /*
 dx = (p1x - p0x)
@@ -227,12 +546,23 @@ b*-dx = p0y + a*dy
 a = -(p0y*dy + p0x*dx) / (dx*dx + dy*dy)
 
 */
-    double dx = p1x - p0x, dy = p1y - p0y;
-    a = -(p0y*dy + p0x*dx) / (dx*dx + dy*dy);
-    double x = p0x + a*dx, y = p0y + a*dy;
+double closest_a(xy &p0, xy &p1, xy &c)
+{
+    double dx = p1.x - p0.x, dy = p1.y - p0.y;
+    double a = -(p0.y*dy + p0.x*dx) / (dx*dx + dy*dy);
+    c = xy(p0.x + a*dx, p0.y + a*dy);
+    return a;
+}
+
+wp closest_a(wp &p, wp &p0, wp &p1, double &a)
+{
+    xy v0, v1, c;
+    toSM(p0.lat, p0.lon, p.lat, p.lon, &v0.x, &v0.y);
+    toSM(p1.lat, p1.lon, p.lat, p.lon, &v1.x, &v1.y);
+    a = closest_a(v0, v1, c);
 
     double lat, lon;
-    fromSM(x, y, p.lat, p.lon, &lat, &lon);
+    fromSM(c.x, c.y, p.lat, p.lon, &lat, &lon);
     return wp(lat, lon);
 }
     
@@ -268,9 +598,9 @@ double distance(wp &p0, wp &p1)
 // return position closest to p1
 bool intersect_circle(wp &p, double dist, wp &p0, wp &p1, wp &w)
 {
-    double p0x, p0y, p1x, p1y;
-    toSM(p0.lat, p0.lon, p.lat, p.lon, &p0x, &p0y);
-    toSM(p1.lat, p1.lon, p.lat, p.lon, &p1x, &p1y);
+    xy v0, v1, x;
+    toSM(p0.lat, p0.lon, p.lat, p.lon, &v0.x, &v0.y);
+    toSM(p1.lat, p1.lon, p.lat, p.lon, &v1.x, &v1.y);
 
     // circle cannot be projected perfectly in mercator...
     // this works for small scale anyway, use north
@@ -278,6 +608,15 @@ bool intersect_circle(wp &p, double dist, wp &p0, wp &p1, wp &w)
     toSM(p.lat + dist/1852.0/60.0, p.lon, p.lat, p.lon, &dx, &dy);
     double r = sqrt(dx*dx + dy*dy);
 
+    if(!intersect_circle(r, v0, v1, x))
+        return false;
+    fromSM(x.x, x.y, p.lat, p.lon, &w.lat, &w.lon);
+    return true;
+}
+
+bool intersect_circle(double r, xy &p0, xy &p1, xy &w)
+{
+    double p0x = p0.x, p0y = p0.y, p1x = p1.x, p1y = p1.y;
     /*
 x^2 + y^2 = r^2
 x = p0x + a * (p1x - p0x)
@@ -325,9 +664,7 @@ a = (-B +- sqrt(B^2 - 4*A*C)) / (2*A)
             a = a0;
     }
 
-    double x = p0x + a * (p1x - p0x);
-    double y = p0y + a * (p1y - p0y);
-    fromSM(x, y, p.lat, p.lon, &w.lat, &w.lon);
+    w = xy(p0x + a * (p1x - p0x), p0y + a * (p1y - p0y));
     return true;
 }
 
@@ -335,9 +672,17 @@ a = (-B +- sqrt(B^2 - 4*A*C)) / (2*A)
 // on segment p0 and p1
 bool intersect(wp &p, double brg, wp &p0, wp &p1, wp &w)
 {
-    double p0x, p0y, p1x, p1y;
-    toSM(p0.lat, p0.lon, p.lat, p.lon, &p0x, &p0y);
-    toSM(p1.lat, p1.lon, p.lat, p.lon, &p1x, &p1y);
+    xy v0, v1, x;
+    toSM(p0.lat, p0.lon, p.lat, p.lon, &v0.x, &v0.y);
+    toSM(p1.lat, p1.lon, p.lat, p.lon, &v1.x, &v1.y);
+    bool ret = intersect(brg, v0, v1, x);
+    fromSM(x.x, x.y, p.lat, p.lon, &w.lat, &w.lon);
+    return ret;
+}
+
+bool intersect(double brg, xy &p0, xy &p1, xy &w)
+{
+    double p0x = p0.x, p0y = p0.y, p1x = p1.x, p1y = p1.y;
 /*
   x = t*cos(brg)
   y = t*sin(brg)
@@ -351,10 +696,7 @@ bool intersect(wp &p, double brg, wp &p0, wp &p1, wp &w)
 */
     double sb = sin(deg2rad(brg)), cb = cos(deg2rad(brg));
     double a = (p0y*cb - p0x*sb) / ((p1x - p0x)*sb - (p1y - p0y)*cb);
-    double x = p0x + a * (p1x - p0x);
-    double y = p0y + a * (p1y - p0y);
-
-    fromSM(x, y, p.lat, p.lon, &w.lat, &w.lon);
+    w = xy(p0x + a * (p1x - p0x), p0y + a * (p1y - p0y));
     return a >= 0 && a <= 1;
 }
 
@@ -24,6 +24,11 @@
  ***************************************************************************
  */
 
+#ifndef _COMPUTATION_H_
+#define _COMPUTATION_H_
+
+#include <vector>
+
 struct wp
 {
     wp() {}
@@ -34,18 +39,113 @@ struct wp
 
 namespace computation_gc
 {
+    struct vector
+    {
+        vector() {}
+        vector(double _x, double _y, double _z) : x(_x), y(_y), z(_z) {}
+        double norm();
+        void normalize();
+        double x, y, z;
+    };
+
+    vector cross(vector &a, vector &b);
+    double dot(vector &a, vector &b);
+    // rotate v about the unit axis k by the angle with sine s and cosine c
+    vector rotate(vector &v, vector &k, double s, double c);
+    vector ll2v(wp &p);
+    wp v2ll(vector a);
+
+    // great circle segment precomputed once so the per tick
+    // computations do not repeat the trig for the route points
+    struct segment
+    {
+        segment() {}
+        segment(vector &_v0, vector &_v1);
+        vector v0, v1, n; // end points and normalized plane normal
+        double d;         // dot(v0, v1)
+    };
+
+    // route segments as separate coordinate arrays for the batched closest
+    // segment search, segment i joins point i and i+1
+    struct segment_array
+    {
+        void resize(int points);
+        void set_point(int i, vector &v);
+        void set_segment(int i, segment &s);
+
+        std::vector<double> px, py, pz;    // points
+        std::vector<double> nx, ny, nz, d; // segment normals and dot(v0, v1)
+    };
+
+    // find segment lo to hi-1 closest to c in one pass, vectorized with
+    // AVX2 or SSE2 when the cpu supports it.  Later segments win ties.
+    int closest_seg_batch(vector &c, segment_array &a, int lo, int hi);
+
     wp closest(wp &p, wp &p0, wp &p1);
     wp closest_seg(wp &p, wp &p0, wp &p1);
     double distance(wp &p0, wp &p1);
     bool intersect_circle(wp &p, double dist, wp &p0, wp &p1, wp &w);
     bool intersect(wp &p, double brg, wp &p0, wp &p1, wp &w);
+
+    vector closest_vector_seg(vector &c, segment &s);
+    wp closest(wp &p, vector &n);
+    wp closest_seg(wp &p, wp &p0, wp &p1, segment &s);
+    bool intersect_circle(wp &p, double dist, segment &s, wp &w);
+    bool intersect(wp &p, double brg, segment &s, wp &w);
+}
+
+// the great circle computations evaluated with polynomial approximations in
+// place of libm trig, positions agree with computation_gc to within 0.1mm
+namespace computation_gc_fast
+{
+    computation_gc::vector ll2v(wp &p);
+    wp v2ll(computation_gc::vector a);
+    double distance(wp &p0, wp &p1);
+    wp closest(wp &p, computation_gc::vector &n);
+    wp closest_seg(wp &p, wp &p0, wp &p1, computation_gc::segment &s);
+    bool intersect_circle(wp &p, double dist, computation_gc::segment &s, wp &w);
 }
 
 namespace computation_mc
 {
+    // mercator meters
+    struct xy
+    {
+        xy() {}
+        xy(double _x, double _y) : x(_x), y(_y) {}
+        double x, y;
+    };
+
+    // mercator projection anchored at a reference position.  Projected
+    // around any other position only differs by a translation, so the
+    // route can be projected once and the computations done in the plane
+    // instead of projecting the segment around the boat on every call.
+    // Re-anchor once the boat drifts more than drift degrees away so the
+    // longitudes stay in the same phase as projected around the boat.
+    struct frame
+    {
+        frame() : valid(false) {}
+        void anchor(wp &a);
+        bool drifted(wp &p);
+        xy project(wp &p);
+        wp unproject(xy &v);
+
+        static const double drift;
+        bool valid;
+        wp origin;
+        double y0; // mercator y of the origin latitude
+    };
+
+    // the computations in the plane with the position at the origin
+    double closest_a(xy &p0, xy &p1, xy &c);
+    bool intersect_circle(double r, xy &p0, xy &p1, xy &w);
+    bool intersect(double brg, xy &p0, xy &p1, xy &w);
+
     wp closest(wp &p, wp &p0, wp &p1);
     wp closest_seg(wp &p, wp &p0, wp &p1);
     double distance(wp &p0, wp &p1);
     bool intersect_circle(wp &p, double dist, wp &p0, wp &p1, wp &w);
     bool intersect(wp &p, double brg, wp &p0, wp &p1, wp &w);
 }
+
+#endif
@@ -122,6 +122,9 @@ ConsoleCanvas::ConsoleCanvas( wxWindow *frame, autopilot_route_pi &pi )
     m_pitemBoxSizerLeg->AddSpacer( 5 );
     m_pitemBoxSizerLeg->Add( pCDI, 0, wxALL | wxEXPAND, 2 );
 
+    pWaypoints = new WaypointList( this, m_pi );
+    m_pitemBoxSizerLeg->Add( pWaypoints, 0, wxALL | wxEXPAND, 2 );
+
     // Deactivate button
     pDeactivate = new wxButton( this, ID_DEACTIVATE, _("Deactivate") );
     m_pitemBoxSizerLeg->Add( pDeactivate, 0, wxALL | wxEXPAND, 2 );
@@ -168,6 +171,7 @@ void ConsoleCanvas::SetColorScheme( PI_ColorScheme cs )
     pTRNG->SetColorScheme( cs );
     pTTTG->SetColorScheme( cs );
     pCDI->SetColorScheme( cs );
+    pWaypoints->SetColorScheme( cs );
 }
 
 void ConsoleCanvas::OnPaint( wxPaintEvent& event )
@@ -188,16 +192,18 @@ void ConsoleCanvas::OnPaint( wxPaintEvent& event )
 
 void ConsoleCanvas::OnShow( wxShowEvent& event )
 {
-    pXTE->Show( m_pi.prefs.ActiveRouteLabel(page, "XTE") );
-    pBRG->Show( m_pi.prefs.ActiveRouteLabel(page, "BRG") );
-    pRNG->Show( m_pi.prefs.ActiveRouteLabel(page, "RNG") );
-    pTTG->Show( m_pi.prefs.ActiveRouteLabel(page, "TTG") );
-    pVMG->Show( m_pi.prefs.ActiveRouteLabel(page, "VMG") );
-    pETA->Show( m_pi.prefs.ActiveRouteLabel(page, "Route ETA") );
-    pTRNG->Show(m_pi.prefs.ActiveRouteLabel(page, "Route RNG") );
-    pTTTG->Show(m_pi.prefs.ActiveRouteLabel(page, "Route TTG") );
-    pCDI->Show( m_pi.prefs.ActiveRouteLabel(page, "Highway") );
-    pDeactivate->Show( m_pi.prefs.ActiveRouteLabel(page, "Deactivate") );
+    typedef autopilot_route_pi::preferences P;
+    pXTE->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_XTE) );
+    pBRG->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_BRG) );
+    pRNG->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_RNG) );
+    pTTG->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_TTG) );
+    pVMG->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_VMG) );
+    pETA->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_ROUTE_ETA) );
+    pTRNG->Show(m_pi.prefs.ActiveRouteLabel(page, P::LABEL_ROUTE_RNG) );
+    pTTTG->Show(m_pi.prefs.ActiveRouteLabel(page, P::LABEL_ROUTE_TTG) );
+    pCDI->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_HIGHWAY) );
+    pWaypoints->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_WAYPOINTS) );
+    pDeactivate->Show( m_pi.prefs.ActiveRouteLabel(page, P::LABEL_DEACTIVATE) );
 
     m_pitemBoxSizerLeg->SetSizeHints( this );
 }
@@ -234,9 +240,11 @@ void ConsoleCanvas::OnContextMenuSelection( wxCommandEvent& event ) {
 void ConsoleCanvas::UpdateRouteData()
 {
     wxString str_buf;
-    double sog, cog, brg, xte, rng, nrng;
-    if(!m_pi.GetConsoleInfo(sog, cog, brg, xte, &rng, &nrng))
+    const nav_state &s = m_pi.NavState();
+    if(!s.valid)
         return;
+    double sog = s.sog, cog = s.cog, brg = s.solution.bearing, xte = s.solution.xte;
+    double rng = s.solution.rng, nrng = s.solution.nrng;
     
     wxString cogstr;
 //            if( g_bShowTrue )
@@ -251,7 +259,7 @@ void ConsoleCanvas::UpdateRouteData()
     double VMG = 0.;
     if( !isnan(cog) && !isnan(sog) )
     {
-        VMG = sog * cos( ( brg - cog ) * M_PI / 180. ) ;
+        VMG = s.solution.vmg;
         str_buf.Printf( _T("%6.2f"), toUsrSpeed_Plugin( VMG ) );
     }
     else
@@ -298,23 +306,7 @@ void ConsoleCanvas::UpdateRouteData()
     pTTG->SetAValue( ttg_s );
 
     //    Remainder of route
-    float trng = rng;
-
-    ap_route &rt = m_pi.m_route;
-    int n_addflag = 0;
-    double lat0, lon0;
-    for(ap_route_iterator it = rt.begin(); it != rt.end(); it++) {
-        waypoint &wp = *it;
-        if( n_addflag ) {
-            double dist;
-            APR_ll_gc_ll_reverse(lat0, lon0, wp.lat, wp.lon, 0, &dist);
-            trng += dist;
-        }
-        lat0 = wp.lat, lon0 = wp.lon;
-
-        if( wp.GUID == m_pi.m_next_route_wp_GUID)
-            n_addflag=1;
-    }
+    float trng = rng + s.solution.remaining;
 
     //                total rng
     wxString strng;
@@ -368,6 +360,77 @@ void ConsoleCanvas::UpdateRouteData()
     pTRNG->Refresh();
     pTTTG->Refresh();
     pCDI->Refresh();
+
+    if( pWaypoints->IsShown() )
+        pWaypoints->UpdateSchedule();
+}
+
+//------------------------------------------------------------------------------
+//    WaypointList Implementation
+//------------------------------------------------------------------------------
+WaypointList::WaypointList( wxWindow *parent, autopilot_route_pi &pi )
+:         wxListCtrl( parent, wxID_ANY, wxDefaultPosition, wxSize( -1, 120 ),
+                      wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL ), m_pi(pi)
+{
+    InsertColumn( 0, _("Waypoint") );
+    InsertColumn( 1, _("RNG") );
+    InsertColumn( 2, _("ETA") );
+}
+
+void WaypointList::UpdateSchedule()
+{
+    const eta_schedule &eta = m_pi.NavState().eta;
+    long count;
+    {
+        wxMutexLocker lock( m_pi.m_nav_mutex );
+        ap_route &rt = m_pi.m_route;
+        count = eta.next >= rt.start && eta.next < rt.size() ? rt.size() - eta.next : 0;
+    }
+    if( GetItemCount() != count )
+        SetItemCount( count );
+    // only the visible rows are evaluated again
+    if( count )
+        RefreshItems( GetTopItem(), wxMin( GetTopItem() + GetCountPerPage(), count - 1 ) );
+}
+
+void WaypointList::SetColorScheme( PI_ColorScheme cs )
+{
+    wxColour c;
+    GetGlobalColor( _T("DILG1"), &c );
+    SetBackgroundColour( c );
+    GetGlobalColor( _T("UBLCK"), &c );
+    SetTextColour( c );
+    Refresh();
+}
+
+wxString WaypointList::OnGetItemText( long item, long column ) const
+{
+    const eta_schedule &eta = m_pi.NavState().eta;
+    // only the visible rows, each held briefly
+    wxMutexLocker lock( m_pi.m_nav_mutex );
+    ap_route &rt = m_pi.m_route;
+    int i = eta.next + item;
+    if( i >= rt.size() )
+        return wxEmptyString;
+
+    wxString s;
+    switch( column ) {
+    case 0:
+        return rt.name[i];
+    case 1:
+        s.Printf( _T("%6.1f"), toUsrDistance_Plugin( eta.distance( rt, i ) ) );
+        return s;
+    case 2:
+        if( !eta.valid( rt, i ) )
+            return _T("---");
+        {
+            wxDateTime t = eta.eta( rt, i );
+            // Show date, e.g. Feb 15, if more than a day ahead
+            return ( t - eta.time ).GetSeconds() > SECONDS_PER_DAY ?
+                t.Format( _T("%b %d %H:%M") ) : t.Format( _T("%H:%M") );
+        }
+    }
+    return wxEmptyString;
 }
 
 void ConsoleCanvas::ShowWithFreshFonts( void )
@@ -639,9 +702,10 @@ void CDI::OnPaint( wxPaintEvent& event )
     int path_length = sy * 3;
     int pix_per_xte = 120;
 
-    double sog, cog, brg, xte;
     ConsoleCanvas *ccp = dynamic_cast<ConsoleCanvas*>(GetParent());
-    if(ccp->m_pi.GetConsoleInfo(sog, cog, brg, xte, 0, 0)) {
+    const nav_state &s = ccp->m_pi.NavState();
+    if(s.valid) {
+        double cog = s.cog, brg = s.solution.bearing, xte = s.solution.xte;
         double angle = 90 - ( brg - cog );
 
         double dy = path_length * sin( angle * M_PI / 180. );
@@ -31,6 +31,8 @@
 
 #include <stdint.h>
 
+#include <wx/listctrl.h>
+
 #include "ocpn_plugin.h"
 #include "autopilot_route_pi.h"
 
@@ -108,6 +110,25 @@ DECLARE_EVENT_TABLE()
 
 
 
+//----------------------------------------------------------------------------
+// WaypointList
+//----------------------------------------------------------------------------
+// upcoming waypoints with their distance and ETA, virtual so only the
+// visible rows are evaluated from the schedule
+class WaypointList : public wxListCtrl
+{
+public:
+      WaypointList(wxWindow *parent, autopilot_route_pi &pi);
+
+      void UpdateSchedule();
+      void SetColorScheme(PI_ColorScheme cs);
+
+private:
+      wxString OnGetItemText(long item, long column) const;
+
+      autopilot_route_pi &m_pi;
+};
+
 //----------------------------------------------------------------------------
 // ConsoleCanvas
 //----------------------------------------------------------------------------
@@ -137,6 +158,7 @@ public:
       AnnunText         *pTRNG;
       AnnunText         *pTTTG;
       CDI               *pCDI;
+      WaypointList      *pWaypoints;
       wxButton          *pDeactivate;
 
       wxFont            *pThisLegFont;
@@ -0,0 +1,201 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#ifndef _GEOMETRY_H_
+#define _GEOMETRY_H_
+
+#include "ocpn_plugin.h"
+#include "georef.h"
+#include "route.h"
+
+// geometry policies the navigation computations are instantiated with,
+// so the computation type is chosen once instead of branching per call
+
+struct great_circle
+{
+    static const bool indexed = true; // segment_index applies
+
+    static void distance_bearing(double lat0, double lon0, double lat1, double lon1,
+                                 double *brg, double *dist) {
+        APR_ll_gc_ll_reverse(lat0, lon0, lat1, lon1, brg, dist);
+    }
+    static void position_bearing(double lat0, double lon0, double brg, double dist,
+                                 double *dlat, double *dlon) {
+        ll_gc_ll(lat0, lon0, brg, dist, dlat, dlon);
+    }
+
+    static double distance(wp &p0, wp &p1) { return computation_gc::distance(p0, p1); }
+    static computation_gc::vector ll2v(wp &p) { return computation_gc::ll2v(p); }
+
+    // position closest to p on the great circle through w along its arrival bearing
+    static wp closest_arrival(ap_route &route, waypoint &w, wp &p) {
+        if(w.index >= 0)
+            return computation_gc::closest(p, route.arrival_normal[w.index]);
+        double dlat, dlon;
+        position_bearing(w.lat, w.lon, w.arrival_bearing, 1, &dlat, &dlon);
+        wp b(dlat, dlon);
+        return computation_gc::closest(p, w, b);
+    }
+    static wp closest_seg(ap_route &route, int seg, wp &p, wp &p0, wp &p1) {
+        return computation_gc::closest_seg(p, p0, p1, route.segments[seg]);
+    }
+    static bool intersect_circle(ap_route &route, int seg, wp &p, double dist,
+                                 wp &p0, wp &p1, wp &w) {
+        return computation_gc::intersect_circle(p, dist, route.segments[seg], w);
+    }
+    static bool intersect(ap_route &route, int seg, wp &p, double brg,
+                          wp &p0, wp &p1, wp &w) {
+        return computation_gc::intersect(p, brg, route.segments[seg], w);
+    }
+
+    // set w to the closest position to p on segments lo to hi-1, returns the segment
+    static int closest_seg_search(ap_route &route, wp &p, int lo, int hi, wp &w) {
+        computation_gc::vector c = computation_gc::ll2v(p);
+        int seg = computation_gc::closest_seg_batch(c, route.segment_arrays, lo, hi);
+        wp p0 = route.point(seg), p1 = route.point(seg+1);
+        w = computation_gc::closest_seg(p, p0, p1, route.segments[seg]);
+        return seg;
+    }
+};
+
+// great circle with the polynomial trig for the per tick computations,
+// positions within 0.1mm of great_circle.  The ellipsoid distances and
+// bearings are shared as they are not the bulk of the work.
+struct great_circle_fast : great_circle
+{
+    static double distance(wp &p0, wp &p1) { return computation_gc_fast::distance(p0, p1); }
+    static computation_gc::vector ll2v(wp &p) { return computation_gc_fast::ll2v(p); }
+
+    static wp closest_arrival(ap_route &route, waypoint &w, wp &p) {
+        if(w.index >= 0)
+            return computation_gc_fast::closest(p, route.arrival_normal[w.index]);
+        return great_circle::closest_arrival(route, w, p);
+    }
+    static wp closest_seg(ap_route &route, int seg, wp &p, wp &p0, wp &p1) {
+        return computation_gc_fast::closest_seg(p, p0, p1, route.segments[seg]);
+    }
+    static bool intersect_circle(ap_route &route, int seg, wp &p, double dist,
+                                 wp &p0, wp &p1, wp &w) {
+        return computation_gc_fast::intersect_circle(p, dist, route.segments[seg], w);
+    }
+
+    static int closest_seg_search(ap_route &route, wp &p, int lo, int hi, wp &w) {
+        computation_gc::vector c = ll2v(p);
+        int seg = computation_gc::closest_seg_batch(c, route.segment_arrays, lo, hi);
+        wp p0 = route.point(seg), p1 = route.point(seg+1);
+        w = computation_gc_fast::closest_seg(p, p0, p1, route.segments[seg]);
+        return seg;
+    }
+};
+
+struct mercator
+{
+    static const bool indexed = false;
+
+    static void distance_bearing(double lat0, double lon0, double lat1, double lon1,
+                                 double *brg, double *dist) {
+        APR_DistanceBearingMercator(lat0, lon0, lat1, lon1, brg, dist);
+    }
+    static void position_bearing(double lat0, double lon0, double brg, double dist,
+                                 double *dlat, double *dlon) {
+        PositionBearingDistanceMercator_Plugin(lat0, lon0, brg, dist, dlat, dlon);
+    }
+
+    static double distance(wp &p0, wp &p1) { return computation_mc::distance(p0, p1); }
+    static computation_gc::vector ll2v(wp &p) { return computation_gc::ll2v(p); }
+
+    static wp closest_arrival(ap_route &route, waypoint &w, wp &p) {
+        // find a position along this bearing
+        double dlat, dlon;
+        position_bearing(w.lat, w.lon, w.arrival_bearing, 1, &dlat, &dlon);
+        wp b(dlat, dlon);
+        return computation_mc::closest(p, w, b);
+    }
+    // the segment computations are done in the route's mercator frame,
+    // the same as projecting around p as computation_mc does
+    static wp closest_seg(ap_route &route, int seg, wp &p, wp &p0, wp &p1) {
+        computation_mc::xy c = route.project(p);
+        return closest_seg(route, seg, c, p0, p1);
+    }
+    static bool intersect_circle(ap_route &route, int seg, wp &p, double dist,
+                                 wp &p0, wp &p1, wp &w) {
+        computation_mc::xy c = route.project(p), x;
+        computation_mc::xy v0 = relative(route, seg, c), v1 = relative(route, seg+1, c);
+        // radius projected north of p
+        wp n(p.lat + dist/1852.0/60.0, p.lon);
+        double r = route.frame.project(n).y - c.y;
+        if(!computation_mc::intersect_circle(r, v0, v1, x))
+            return false;
+        w = unproject(route, x, c);
+        return true;
+    }
+    static bool intersect(ap_route &route, int seg, wp &p, double brg,
+                          wp &p0, wp &p1, wp &w) {
+        computation_mc::xy c = route.project(p), x;
+        computation_mc::xy v0 = relative(route, seg, c), v1 = relative(route, seg+1, c);
+        bool ret = computation_mc::intersect(brg, v0, v1, x);
+        w = unproject(route, x, c);
+        return ret;
+    }
+
+    static int closest_seg_search(ap_route &route, wp &p, int lo, int hi, wp &w) {
+        computation_mc::xy c = route.project(p);
+        int seg = -1;
+        double best_dist = INFINITY;
+        for(int i=lo; i<hi; i++) {
+            wp p0 = route.point(i), p1 = route.point(i+1);
+            wp x = closest_seg(route, i, c, p0, p1);
+            double dist = distance(p, x);
+            if(dist <= best_dist) {
+                best_dist = dist;
+                w = x;
+                seg = i;
+            }
+        }
+        return seg;
+    }
+
+private:
+    // point i relative to c
+    static computation_mc::xy relative(ap_route &route, int i, computation_mc::xy &c) {
+        return computation_mc::xy(route.projected[i].x - c.x, route.projected[i].y - c.y);
+    }
+    static wp unproject(ap_route &route, computation_mc::xy &v, computation_mc::xy &c) {
+        computation_mc::xy f(v.x + c.x, v.y + c.y);
+        return route.frame.unproject(f);
+    }
+    static wp closest_seg(ap_route &route, int seg, computation_mc::xy &c, wp &p0, wp &p1) {
+        computation_mc::xy v0 = relative(route, seg, c), v1 = relative(route, seg+1, c), x;
+        double a = computation_mc::closest_a(v0, v1, x);
+        if(a < 0)
+            return p0;
+        if(a > 1)
+            return p1;
+        return unproject(route, x, c);
+    }
+};
+
+#endif
@@ -831,6 +831,23 @@ void MolodenskyTransform (double lat, double lon, double *to_lat, double *to_lon
 #define ONEPI   3.14159265358979323846
 #define MERI_TOL 1e-9
 
+/*   WGS84 terms of the geodesic solvers, these were computed on every call.
+     es = 2f - f^2 so onef = sqrt(1 - es) = 1 - f and geod_f = f
+*/
+#define WGS84_F (1.0 / 298.257223563)
+
+struct geod_ellipsoid {
+      double a;                   /* semimajor axis meters */
+      double onef;
+      double f, f2, f4, f64;
+};
+
+static const struct geod_ellipsoid geod_wgs84 = {
+      6378137.0,
+      1. - WGS84_F,
+      WGS84_F, WGS84_F / 2, WGS84_F / 4, WGS84_F * WGS84_F / 64
+};
+
 
 double adjlon (double lon) {
       if (fabs(lon) <= SPI) return( lon );
@@ -865,7 +882,7 @@ void ll_gc_ll(double lat, double lon, double brg, double dist, double *dlat, dou
  int ellipse;
  double geod_f;
  double geod_a;
- double es, onef, f, f4;//f64, f2;
+ double onef, f4;
 
     /*      Setup the static parameters  */
     phi1 = lat * DEGREE;            /* Initial Position  */
@@ -881,15 +898,10 @@ void ll_gc_ll(double lat, double lon, double brg, double dist, double *dlat, dou
       To avoid having to include <geodesic,h>
       */
       ellipse = 0;
-      f = 1.0 / WGSinvf;       /* WGS84 ellipsoid flattening parameter */
-      geod_a = WGS84_semimajor_axis_meters;
-
-      es = 2 * f - f * f;
-      onef = sqrt(1. - es);
-      geod_f = 1 - onef;
-//      f2 = geod_f/2;
-      f4 = geod_f/4;
-//      f64 = geod_f*geod_f/64;
+      geod_a = geod_wgs84.a;
+      onef = geod_wgs84.onef;
+      geod_f = geod_wgs84.f;
+      f4 = geod_wgs84.f4;
 
       al12 = adjlon(al12); /* reduce to  +- 0-PI */
       signS = fabs(al12) > HALFPI ? 1 : 0;
@@ -996,107 +1008,96 @@ void ll_gc_ll(double lat, double lon, double brg, double dist, double *dlat, dou
     *dlon = lam2 / DEGREE;
 }
 
-void APR_ll_gc_ll_reverse(double lat1, double lon1, double lat2, double lon2,
-                     double *bearing, double *dist)
-{
-// double th1,costh1,sinth1,sina12,cosa12,M,N,c1,c2,D,P,s1;
-// int merid, signS;
-
-/*   Input/Output from geodesic functions   */
- double al12;           /* Forward azimuth */
- double al21;           /* Back azimuth    */
- double geod_S;         /* Distance        */
- double phi1, lam1, phi2, lam2;
-
- int ellipse;
- double geod_f;
- double geod_a;
- double es, onef, f, f64, f2, f4;
+/*   Position for the inverse solver, the sine and cosine of half its
+     reduced latitude th are all it needs so they are computed once per
+     position rather than per pair.  tan(th) = onef * tan(phi) so
+     cos(th) and sin(th) follow without the atan, then the half angles.
+*/
+struct geod_inv_point {
+      double s, c;                /* sin(th/2), cos(th/2) */
+      double lam;
+};
 
-    /*      Setup the static parameters  */
-    phi1 = lat1 * DEGREE;            /* Initial Position  */
-    lam1 = lon1 * DEGREE;
-    phi2 = lat2 * DEGREE;
-    lam2 = lon2 * DEGREE;
+static void geod_inv_point_init(double lat, double lon, struct geod_inv_point *p)
+{
+      double phi = lat * DEGREE, sinphi = geod_wgs84.onef * sin(phi), cosphi = cos(phi);
+      double r = sqrt(cosphi * cosphi + sinphi * sinphi);
+      p->c = sqrt(.5 * (1 + cosphi / r));
+      p->s = sinphi / r / (2 * p->c);
+      p->lam = lon * DEGREE;
+}
 
 //void geod_inv(struct georef_state *state)
+static void geod_inv(const struct geod_inv_point *p1, const struct geod_inv_point *p2,
+                     double *bearing, double *dist)
 {
-      double      th1,th2,thm,dthm,dlamm,dlam,sindlamm,costhm,sinthm,cosdthm,
+      const struct geod_ellipsoid *e = &geod_wgs84;
+      double      dlamm,dlam,sindlamm,costhm,sinthm,cosdthm,
       sindthm,L,E,cosd,d,X,Y,T,sind,tandlammp,u,v,D,A,B;
-
-
-            /*   Stuff the WGS84 projection parameters as necessary
-      To avoid having to include <geodesic,h>
-            */
-
-      ellipse = 1;
-      f = 1.0 / WGSinvf;       /* WGS84 ellipsoid flattening parameter */
-      geod_a = WGS84_semimajor_axis_meters;
-
-      es = 2 * f - f * f;
-      onef = sqrt(1. - es);
-      geod_f = 1 - onef;
-      f2 = geod_f/2;
-      f4 = geod_f/4;
-      f64 = geod_f*geod_f/64;
-
-
-      if (ellipse) {
-            th1 = atan(onef * tan(phi1));
-            th2 = atan(onef * tan(phi2));
-      } else {
-            th1 = phi1;
-            th2 = phi2;
-      }
-      thm = .5 * (th1 + th2);
-      dthm = .5 * (th2 - th1);
-      dlamm = .5 * ( dlam = adjlon(lam2 - lam1) );
-      if (fabs(dlam) < DTOL && fabs(dthm) < DTOL) {
-            al12 =  al21 = geod_S = 0.;
+      double al12, geod_S;
+
+      /* thm and dthm are the sum and difference of the half angles */
+      sindthm = p2->s * p1->c - p2->c * p1->s;
+      dlamm = .5 * ( dlam = adjlon(p2->lam - p1->lam) );
+      if (fabs(dlam) < DTOL && fabs(sindthm) < DTOL) {
+            if(bearing)
+                  *bearing = 0;
+            if(dist)
+                  *dist = 0;
             return;
       }
       sindlamm = sin(dlamm);
-      costhm = cos(thm);      sinthm = sin(thm);
-      cosdthm = cos(dthm);    sindthm = sin(dthm);
+      costhm = p1->c * p2->c - p1->s * p2->s;
+      sinthm = p1->s * p2->c + p1->c * p2->s;
+      cosdthm = p2->c * p1->c + p2->s * p1->s;
       L = sindthm * sindthm + (cosdthm * cosdthm - sinthm * sinthm)
                   * sindlamm * sindlamm;
-      d = acos(cosd = 1 - L - L);
-      if (ellipse) {
-            E = cosd + cosd;
-            sind = sin( d );
-            Y = sinthm * cosdthm;
-            Y *= (Y + Y) / (1. - L);
-            T = sindthm * costhm;
-            T *= (T + T) / L;
-            X = Y + T;
-            Y -= T;
-            T = d / sind;
-            D = 4. * T * T;
-            A = D * E;
-            B = D + D;
-            geod_S = geod_a * sind * (T - f4 * (T * X - Y) +
-                        f64 * (X * (A + (T - .5 * (A - E)) * X) -
-                        Y * (B + E * Y) + D * X * Y));
-            tandlammp = tan(.5 * (dlam - .25 * (Y + Y - E * (4. - X)) *
-                        (f2 * T + f64 * (32. * T - (20. * T - A)
-                        * X - (B + 4.) * Y)) * tan(dlam)));
-      } else {
-            geod_S = geod_a * d;
-            tandlammp = tan(dlamm);
-      }
+      /* L = sin^2(d/2), through the half angle d and sin(d) keep their
+         digits when close where acos(1 - 2L) loses half of them.  L rounds
+         past 1 at the antipode, where the solution is meaningless but
+         stays finite as it did through acos and sin(d) */
+      if (L > 1 - DTOL)
+            L = 1 - DTOL;
+      cosd = 1 - L - L;
+      d = 2 * asin(sqrt(L));
+      E = cosd + cosd;
+      sind = 2 * sqrt(L * (1 - L));
+      Y = sinthm * cosdthm;
+      Y *= (Y + Y) / (1. - L);
+      T = sindthm * costhm;
+      T *= (T + T) / L;
+      X = Y + T;
+      Y -= T;
+      T = d / sind;
+      D = 4. * T * T;
+      A = D * E;
+      B = D + D;
+      geod_S = e->a * sind * (T - e->f4 * (T * X - Y) +
+                  e->f64 * (X * (A + (T - .5 * (A - E)) * X) -
+                  Y * (B + E * Y) + D * X * Y));
+      tandlammp = tan(.5 * (dlam - .25 * (Y + Y - E * (4. - X)) *
+                  (e->f2 * T + e->f64 * (32. * T - (20. * T - A)
+                  * X - (B + 4.) * Y)) * tan(dlam)));
       u = atan2(sindthm , (tandlammp * costhm));
       v = atan2(cosdthm , (tandlammp * sinthm));
       al12 = adjlon(TWOPI + v - u);
-      al21 = adjlon(TWOPI - v - u);
-}
 
-    if(al12 < 0)
-       al12 += 2*PI;
+      if(al12 < 0)
+            al12 += 2*PI;
 
-    if(bearing)
-       *bearing = al12 / DEGREE;
-    if(dist)
-       *dist = geod_S / 1852.0;
+      if(bearing)
+            *bearing = al12 / DEGREE;
+      if(dist)
+            *dist = geod_S / 1852.0;
+}
+
+void APR_ll_gc_ll_reverse(double lat1, double lon1, double lat2, double lon2,
+                     double *bearing, double *dist)
+{
+      struct geod_inv_point p1, p2;
+      geod_inv_point_init(lat1, lon1, &p1);
+      geod_inv_point_init(lat2, lon2, &p2);
+      geod_inv(&p1, &p2, bearing, dist);
 }
 
 
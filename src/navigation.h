@@ -0,0 +1,247 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#ifndef _NAVIGATION_H_
+#define _NAVIGATION_H_
+
+#include <atomic>
+#include <chrono>
+#include <math.h>
+
+#include <wx/thread.h>
+
+#include "route.h"
+
+#ifndef M_PI
+      #define M_PI        3.1415926535897931160E0      /* pi */
+#endif
+
+// hands the latest value from one thread to another without locks.  The
+// writer fills the back slot and swaps it with the middle one, the reader
+// swaps the middle slot for its front slot when a newer value is there, so
+// neither waits and the slot being read is never written.
+template<class T> class latest
+{
+public:
+    latest() : m_front(0), m_back(1), m_middle(2) {}
+
+    // writer
+    T &back() { return m_slots[m_back]; }
+    void publish() { m_back = m_middle.exchange(m_back | fresh) & ~fresh; }
+
+    // reader, true if a value was published since the last fetch
+    bool fetch() {
+        if(!(m_middle.load() & fresh))
+            return false;
+        m_front = m_middle.exchange(m_front) & ~fresh;
+        return true;
+    }
+    const T &front() const { return m_slots[m_front]; }
+
+private:
+    static const int fresh = 4;
+    T m_slots[3];
+    int m_front, m_back;
+    std::atomic<int> m_middle; // slot index, or'ed with fresh when published
+};
+
+// time from receiving a fix to sending the sentences computed from it
+struct latency_stats
+{
+    latency_stats() : count(0), last(0), average(0), max(0) {}
+    void add(double ms) {
+        last = ms;
+        average = count ? average*.9 + ms*.1 : ms;
+        if(ms > max)
+            max = ms;
+        count++;
+    }
+
+    int count;
+    double last, average, max; // milliseconds
+};
+
+// extrapolates the position from the last fix along its course at its
+// speed, turning at the rate seen between the last two fixes, so the
+// output can run faster than the fixes arrive.  Predictions are always
+// made from the fix itself so errors do not accumulate between fixes.
+class dead_reckoning
+{
+public:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    dead_reckoning() : m_valid(false), m_rot(0) {}
+
+    void fix(double lat, double lon, double sog, double cog, time_point t) {
+        double dt = std::chrono::duration<double>(t - m_time).count();
+        if(m_valid && dt > 0 && dt < max_age && sog > 1 && m_sog > 1) {
+            double dcog = remainder(cog - m_cog, 360);
+            double rot = dcog / dt;
+            if(fabs(rot) > max_rot)
+                rot = 0; // more likely noise than a turn
+            m_rot = m_rot*.5 + rot*.5;
+        } else
+            m_rot = 0;
+
+        m_lat = lat, m_lon = lon, m_sog = sog, m_cog = cog, m_time = t;
+        m_valid = true;
+    }
+
+    // position and course at t, returns the seconds extrapolated over, 0
+    // with the fix itself once it is too old, or -1 without a fix
+    double predict(time_point t, double &lat, double &lon, double &cog) const {
+        if(!m_valid)
+            return -1;
+        lat = m_lat, lon = m_lon, cog = m_cog;
+        double dt = std::chrono::duration<double>(t - m_time).count();
+        if(dt > max_age || dt <= 0)
+            return 0;
+        if(m_sog < .1 || fabs(m_lat) > 89)
+            return dt;
+
+        // short enough to treat the earth as flat, in nautical miles
+        double d = m_sog * dt / 3600, c0 = m_cog * M_PI/180;
+        double turn = m_rot * dt * M_PI/180, north, east;
+        if(fabs(turn) < 1e-3) {
+            north = d * cos(c0);
+            east = d * sin(c0);
+        } else {
+            double r = d / turn; // the arc of a constant rate turn
+            north = r * (sin(c0 + turn) - sin(c0));
+            east = r * (cos(c0) - cos(c0 + turn));
+            cog = fmod(m_cog + m_rot*dt + 360, 360);
+        }
+
+        lat = m_lat + north/60;
+        lon = remainder(m_lon + east/(60*cos(m_lat*M_PI/180)), 360);
+        return dt;
+    }
+
+    // beyond this a fix is used as it is
+    static constexpr double max_age = 3;   // seconds
+    static constexpr double max_rot = 20;  // degrees per second
+
+private:
+    bool m_valid;
+    double m_lat, m_lon, m_sog, m_cog;
+    double m_rot; // degrees per second
+    time_point m_time;
+};
+
+// the navigation solved once each update, which the nmea sentences, the
+// console and the overlay all read instead of solving it again
+struct nav_solution
+{
+    nav_solution() : arrival(false), rng(0), wp_bearing(0), leg_bearing(0),
+                     bearing(0), xte(0), nrng(0), vmg(0), remaining(0) {}
+
+    bool arrival;            // inside the arrival circle
+    double rng, wp_bearing;  // from the boat to the current waypoint
+    double leg_bearing;      // arrival bearing of the current waypoint
+    double bearing, xte;     // to steer
+    double nrng;             // range along the bearing to steer
+    double vmg;              // speed made good along the bearing to steer
+    double remaining;        // along the route after the current waypoint
+};
+
+// navigation results published by the worker for the display
+struct nav_state
+{
+    nav_state() : valid(false) {}
+
+    bool valid;               // a route is being followed
+    double lat, lon, sog, cog; // the fix they were computed from
+    waypoint current_wp;
+    nav_solution solution;
+    eta_schedule eta;
+    latency_stats latency;
+};
+
+// when one nmea sentence is next sent, at its own rate, or sooner when the
+// steering changed more than the thresholds since it was last sent
+class sentence_schedule
+{
+public:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    sentence_schedule() : m_sent(false) {}
+    void reset() { m_sent = false; }
+
+    // rate in Hz, at every update if 0.  slack lets a sentence go an
+    // update early rather than most of an update late
+    bool due(time_point now, double rate, double slack, const nav_solution &n,
+             bool on_change, double bearing_threshold, double xte_threshold) const {
+        if(!m_sent || rate <= 0 ||
+           std::chrono::duration<double>(now - m_time).count() + slack >= 1/rate)
+            return true;
+        return on_change &&
+            (fabs(remainder(n.bearing - m_bearing, 360)) >= bearing_threshold ||
+             fabs(n.xte - m_xte) >= xte_threshold || n.arrival != m_arrival);
+    }
+
+    void sent(time_point now, const nav_solution &n) {
+        m_sent = true;
+        m_time = now;
+        m_bearing = n.bearing;
+        m_xte = n.xte;
+        m_arrival = n.arrival;
+    }
+
+private:
+    bool m_sent;
+    time_point m_time;
+    double m_bearing, m_xte; // steering when last sent
+    bool m_arrival;
+};
+
+class autopilot_route_pi;
+
+// computes the navigation and sends the nmea output away from the gui
+// thread so dialogs and redraws do not hold up the autopilot
+class NavigationThread : public wxThread
+{
+public:
+    NavigationThread(autopilot_route_pi &pi);
+
+    void Stop();
+    // navigate now, even without a new fix
+    void Wake() { m_woken = true; m_wake.Post(); }
+    // a new fix is waiting, navigated at once when triggered by fixes
+    void Fix() { m_wake.Post(); }
+
+    // without fixes, compute again after this long when triggered by fixes
+    static const int watchdog = 2000; // ms
+
+protected:
+    ExitCode Entry();
+
+private:
+    autopilot_route_pi &m_pi;
+    wxSemaphore m_wake;
+    std::atomic<bool> m_stop, m_woken;
+};
+
+#endif
@@ -0,0 +1,301 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#include <string.h>
+
+#ifndef __WXMSW__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#include "nmea_output.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// the address split at its last colon, a lone number is taken as the port.
+// An ipv6 host is written in brackets to give a port, [::1]:10110
+static void SplitAddress(const wxString &address, wxString &host, wxString &port)
+{
+    long l;
+    if(address.StartsWith("[") && address.Find(']') != wxNOT_FOUND) {
+        host = address.Mid(1).BeforeFirst(']');
+        port = address.AfterFirst(']').AfterFirst(':');
+    } else if(address.Freq(':') > 1) {
+        // a bare ipv6 host
+        host = address;
+        port = "";
+    } else if(address.Find(':', true) != wxNOT_FOUND) {
+        host = address.BeforeLast(':');
+        port = address.AfterLast(':');
+    } else if(address.ToLong(&l)) {
+        host = "";
+        port = address;
+    } else {
+        host = address;
+        port = "";
+    }
+}
+
+nmea_output::nmea_output(Type type, const wxString &address)
+    : wxThread(wxTHREAD_JOINABLE), m_type(type), m_address(address),
+      m_head(0), m_count(0), m_stop(false), m_dropped(0), m_fd(-1)
+{
+}
+
+nmea_output::~nmea_output()
+{
+#ifndef __WXMSW__
+    for(unsigned int i=0; i<m_clients.size(); i++)
+        close(m_clients[i]);
+    if(m_fd >= 0)
+        close(m_fd);
+#endif
+}
+
+#ifdef __WXMSW__
+
+bool nmea_output::Open()
+{
+    m_error = "direct nmea output is not supported on this platform";
+    return false;
+}
+
+void nmea_output::Accept() {}
+void nmea_output::Send(const char *data, int len) {}
+bool nmea_output::OpenSerial(const wxString &device, int baud) { return false; }
+
+#else
+
+bool nmea_output::Open()
+{
+    wxString host, port;
+    SplitAddress(m_address, host, port);
+
+    if(m_type == SERIAL) {
+        long baud = 4800;
+        if(!port.ToLong(&baud)) {
+            host = m_address;
+            baud = 4800;
+        }
+        return OpenSerial(host, baud);
+    }
+
+    if(port.IsEmpty())
+        port = "10110";
+    if(host.IsEmpty() && m_type == UDP)
+        host = "localhost";
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = m_type == UDP ? SOCK_DGRAM : SOCK_STREAM;
+    hints.ai_flags = m_type == TCP ? AI_PASSIVE : 0;
+    int err = getaddrinfo(host.IsEmpty() ? NULL : (const char*)host.mb_str(),
+                          port.mb_str(), &hints, &res);
+    if(err) {
+        m_error = m_address + ": " + gai_strerror(err);
+        return false;
+    }
+
+    m_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if(m_fd < 0) {
+        m_error = m_address + ": " + strerror(errno);
+        freeaddrinfo(res);
+        return false;
+    }
+
+    int one = 1;
+    bool ok = true;
+    if(m_type == UDP) {
+        setsockopt(m_fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof one);
+        m_addr.assign((char*)res->ai_addr, (char*)res->ai_addr + res->ai_addrlen);
+    } else {
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        ok = bind(m_fd, res->ai_addr, res->ai_addrlen) == 0 && listen(m_fd, 4) == 0;
+    }
+    freeaddrinfo(res);
+
+    // a full socket buffer drops the sentence rather than waiting
+    if(!ok || fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK) < 0) {
+        m_error = m_address + ": " + strerror(errno);
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool nmea_output::OpenSerial(const wxString &device, int baud)
+{
+    static const struct { int baud; speed_t speed; } speeds[] = {
+        {4800, B4800}, {9600, B9600}, {19200, B19200}, {38400, B38400},
+        {57600, B57600}, {115200, B115200}};
+    speed_t speed = 0;
+    for(unsigned int i=0; i<sizeof speeds / sizeof *speeds; i++)
+        if(speeds[i].baud == baud)
+            speed = speeds[i].speed;
+    if(!speed) {
+        m_error = wxString::Format("%s: unsupported baud rate %d", device, baud);
+        return false;
+    }
+
+    // opened without waiting for carrier detect
+    m_fd = open(device.mb_str(), O_WRONLY | O_NOCTTY | O_NONBLOCK);
+    struct termios t;
+    if(m_fd < 0 || tcgetattr(m_fd, &t) < 0) {
+        m_error = device + ": " + strerror(errno);
+        if(m_fd >= 0)
+            close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    cfmakeraw(&t);
+    t.c_cflag |= CLOCAL;
+    t.c_cflag &= ~CRTSCTS;
+    cfsetispeed(&t, speed);
+    cfsetospeed(&t, speed);
+    tcsetattr(m_fd, TCSANOW, &t);
+
+    // writes wait for the port, which paces this thread to the baud rate
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_NONBLOCK);
+    return true;
+}
+
+void nmea_output::Accept()
+{
+    for(;;) {
+        int fd = accept(m_fd, NULL, NULL);
+        if(fd < 0)
+            return;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+        m_clients.push_back(fd);
+    }
+}
+
+void nmea_output::Send(const char *data, int len)
+{
+    switch(m_type) {
+    case UDP:
+        if(sendto(m_fd, data, len, 0, (struct sockaddr*)&m_addr[0], m_addr.size()) != len)
+            m_dropped++;
+        break;
+    case TCP:
+        for(unsigned int i=0; i<m_clients.size(); i++) {
+            ssize_t n = send(m_clients[i], data, len, MSG_NOSIGNAL);
+            if(n == len)
+                continue;
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                m_dropped++;
+                continue;
+            }
+            // gone, or a partial sentence was written so the stream is broken
+            close(m_clients[i]);
+            m_clients.erase(m_clients.begin() + i--);
+        }
+        break;
+    case SERIAL:
+        while(len > 0) {
+            ssize_t n = write(m_fd, data, len);
+            if(n < 0) {
+                if(errno == EINTR)
+                    continue;
+                m_dropped++;
+                break;
+            }
+            data += n;
+            len -= n;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+#endif
+
+void nmea_output::Stop()
+{
+    m_stop = true;
+    m_ready.Post();
+    Wait();
+}
+
+// from any thread, the sentence including its line ending
+void nmea_output::Write(const char *sentence)
+{
+    wxMutexLocker lock(m_queue_mutex);
+    if(m_count == queue_size) {
+        // the newest sentences matter most for steering
+        m_head = (m_head + 1) % queue_size;
+        m_count--;
+        m_dropped++;
+    }
+    int i = (m_head + m_count) % queue_size;
+    strncpy(m_queue[i], sentence, nmea_sentence::max_length);
+    m_queue[i][nmea_sentence::max_length] = 0;
+    m_count++;
+    m_ready.Post();
+}
+
+void nmea_output::Flush()
+{
+    char sentence[nmea_sentence::max_length + 1];
+    for(;;) {
+        {
+            wxMutexLocker lock(m_queue_mutex);
+            if(!m_count)
+                return;
+            memcpy(sentence, m_queue[m_head], sizeof sentence);
+            m_head = (m_head + 1) % queue_size;
+            m_count--;
+        }
+        Send(sentence, strlen(sentence));
+    }
+}
+
+wxThread::ExitCode nmea_output::Entry()
+{
+    while(!m_stop) {
+        // a tcp server also looks for new clients while idle
+        m_ready.WaitTimeout(m_type == TCP ? 250 : 1000);
+        if(m_type == TCP)
+            Accept();
+        Flush();
+    }
+    return 0;
+}
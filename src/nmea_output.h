@@ -0,0 +1,91 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#ifndef _NMEA_OUTPUT_H_
+#define _NMEA_OUTPUT_H_
+
+#include <atomic>
+#include <vector>
+
+#include <wx/string.h>
+#include <wx/thread.h>
+
+#include "nmea_sentence.h"
+
+// nmea sentences written by the plugin itself to a udp address, the
+// clients of a tcp server or a serial port, so the autopilot output does
+// not wait on the opencpn multiplexer.  Sentences are queued without
+// waiting on the output and written by this thread; when the output can
+// not keep up the oldest queued sentences are dropped.
+class nmea_output : public wxThread
+{
+public:
+    enum Type { OPENCPN, UDP, TCP, SERIAL };
+
+    // host:port for udp (port 10110 and localhost by default), [host:]port
+    // to listen on for tcp, device[:baud] for serial (4800 by default).
+    // An ipv6 host with a port is bracketed, [::1]:10110
+    nmea_output(Type type, const wxString &address);
+    ~nmea_output();
+
+    // before Run, false with Error() set if the output can not be opened
+    bool Open();
+    void Stop();
+
+    void Write(const char *sentence);
+
+    const wxString &Error() const { return m_error; }
+    int Dropped() const { return m_dropped; }
+
+    static const int queue_size = 64;
+
+protected:
+    ExitCode Entry();
+
+private:
+    void Accept();
+    void Flush();
+    void Send(const char *data, int len);
+    bool OpenSerial(const wxString &device, int baud);
+
+    Type m_type;
+    wxString m_address, m_error;
+
+    // ring of queued sentences, guarded by m_queue_mutex
+    wxMutex m_queue_mutex;
+    char m_queue[queue_size][nmea_sentence::max_length + 1];
+    int m_head, m_count;
+    wxSemaphore m_ready;
+
+    std::atomic<bool> m_stop;
+    std::atomic<int> m_dropped;
+
+    int m_fd; // udp socket, tcp listener or serial port
+    std::vector<int> m_clients;
+    std::vector<char> m_addr; // udp destination
+};
+
+#endif
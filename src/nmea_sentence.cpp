@@ -0,0 +1,286 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#include <math.h>
+
+#include "nmea_sentence.h"
+#include "navigation.h"
+
+nmea_sentence::nmea_sentence(const char *talker, const char *type)
+    : m_len(0), m_overflow(false)
+{
+    put('$');
+    while(*talker)
+        put(*talker++);
+    while(*type)
+        put(*type++);
+}
+
+void nmea_sentence::field(const char *s)
+{
+    put(',');
+    while(*s)
+        put(*s++);
+}
+
+void nmea_sentence::field(char c)
+{
+    put(',');
+    put(c);
+}
+
+void nmea_sentence::field(const wxString &s, int max)
+{
+    put(',');
+    int n = 0;
+    for(wxString::const_iterator it = s.begin(); it != s.end() && n < max; ++it, n++) {
+        wxUniChar::value_type u = (*it).GetValue();
+        // characters the sentence can not carry are replaced
+        if(u < ' ' || u > '~' || u == ',' || u == '*' || u == '$' || u == '!' || u == '\\')
+            put('_');
+        else
+            put(u);
+    }
+}
+
+void nmea_sentence::field(double v, int decimals)
+{
+    static const unsigned long long scale[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    put(',');
+    if(isnan(v) || fabs(v) >= 1e12 || decimals < 0 || decimals > 6)
+        return;
+
+    unsigned long long s = scale[decimals];
+    unsigned long long n = (unsigned long long)(fabs(v)*s + .5);
+    if(v < 0 && n)
+        put('-');
+    digits(n / s, 1);
+    if(decimals) {
+        put('.');
+        digits(n % s, decimals);
+    }
+}
+
+// whole degrees then minutes to 4 decimals, rounded together so 59.99999
+// minutes carries into the degrees
+void nmea_sentence::degrees(double v, int width)
+{
+    unsigned long long n = (unsigned long long)(fabs(v)*600000 + .5);
+    digits(n / 600000, width);
+    n %= 600000;
+    digits(n / 10000, 2);
+    put('.');
+    digits(n % 10000, 4);
+}
+
+void nmea_sentence::latitude(double lat)
+{
+    put(',');
+    if(isnan(lat)) {
+        put(',');
+        return;
+    }
+    degrees(lat, 2);
+    field(lat < 0 ? 'S' : 'N');
+}
+
+void nmea_sentence::longitude(double lon)
+{
+    put(',');
+    if(isnan(lon)) {
+        put(',');
+        return;
+    }
+    degrees(lon, 3);
+    field(lon < 0 ? 'W' : 'E');
+}
+
+const char *nmea_sentence::finish()
+{
+    static const char hex[] = "0123456789ABCDEF";
+    unsigned char checksum = 0;
+    for(int i=1; i<m_len; i++)
+        checksum ^= m_buf[i];
+
+    put('*');
+    put(hex[checksum >> 4]);
+    put(hex[checksum & 0xf]);
+    put('\r');
+    put('\n');
+    if(m_overflow)
+        return NULL;
+    m_buf[m_len] = 0;
+    return m_buf;
+}
+
+// v in decimal, zero padded to at least width digits
+void nmea_sentence::digits(unsigned long long v, int width)
+{
+    char d[20];
+    int n = 0;
+    do {
+        d[n++] = '0' + v % 10;
+        v /= 10;
+    } while(v);
+    while(n < width)
+        d[n++] = '0';
+    while(n)
+        put(d[--n]);
+}
+
+static void two_digits(char *p, int v)
+{
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+void utc_fields::set(time_t t)
+{
+    if(t == m_time)
+        return;
+    m_time = t;
+
+    // utc has no leap seconds in time_t, so the fields follow from
+    // whole days without gmtime or the locale
+    long day = (long)(t / 86400), sec = (long)(t % 86400);
+    if(sec < 0) {
+        day--;
+        sec += 86400;
+    }
+    two_digits(m_hhmmss, sec / 3600);
+    two_digits(m_hhmmss + 2, sec / 60 % 60);
+    two_digits(m_hhmmss + 4, sec % 60);
+    m_hhmmss[6] = 0;
+
+    if(day == m_day)
+        return;
+    m_day = day;
+
+    // civil date from days since 1970-01-01
+    long z = day + 719468;
+    long era = (z >= 0 ? z : z - 146096) / 146097;
+    long doe = z - era * 146097;
+    long yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    long doy = doe - (365*yoe + yoe/4 - yoe/100);
+    long mp = (5*doy + 2) / 153;
+    int d = doy - (153*mp + 2)/5 + 1;
+    int m = mp < 10 ? mp + 3 : mp - 9;
+    long y = yoe + era * 400 + (m <= 2);
+    two_digits(m_ddmmyy, d);
+    two_digits(m_ddmmyy + 2, m);
+    two_digits(m_ddmmyy + 4, (int)(y % 100));
+    m_ddmmyy[6] = 0;
+}
+
+nmea_sentence nmea_rmb(const nav_solution &n, const wxString &origin,
+                       const waypoint &destination, double sog)
+{
+    nmea_sentence s("EC", "RMB"); // talker overrided by opencpn anyway
+    s.status(true);
+    s.field(fabs(n.xte), 3);
+    s.field(n.xte < 0 ? 'L' : 'R');
+    s.field(origin, 6);
+    s.field(destination.name, 6);
+    s.latitude(destination.lat);
+    s.longitude(destination.lon);
+    s.field(n.rng, 3);
+    s.field(n.wp_bearing, 1);
+    s.field(sog, 2);
+    s.status(n.arrival);
+    return s;
+}
+
+nmea_sentence nmea_rmc(utc_fields &utc, time_t t, double lat, double lon,
+                       double sog, double cog, double variation)
+{
+    utc.set(t);
+
+    nmea_sentence s("EC", "RMC");
+    s.field(utc.time());
+    s.status(true);
+    s.latitude(lat);
+    s.longitude(lon);
+    s.field(sog, 2);
+    s.field(cog, 1);
+    s.field(utc.date());
+    // left empty when the variation is unknown
+    s.field(fabs(variation), 1);
+    s.field(isnan(variation) ? "" : variation < 0. ? "W" : "E");
+    return s;
+}
+
+// true bearing to magnetic, from 0 to 360
+static double magnetic(double bearing, double declination)
+{
+    bearing += declination;
+    while(bearing < 0)
+        bearing += 360;
+    while(bearing >= 360)
+        bearing -= 360;
+    return bearing;
+}
+
+nmea_sentence nmea_apb(const nav_solution &n, const wxString &destination,
+                       double declination)
+{
+    double origin = n.leg_bearing, present = n.wp_bearing, steer = n.bearing;
+    const char *units = "T";
+    if(!isnan(declination)) {
+        units = "M";
+        origin = magnetic(origin, declination);
+        present = magnetic(present, declination);
+        steer = magnetic(steer, declination);
+    }
+
+    nmea_sentence s("EC", "APB");
+    s.status(true); // loran blink
+    s.status(true); // loran cycle lock
+    s.field(fabs(n.xte), 3);
+    s.field(n.xte < 0 ? 'L' : 'R');
+    s.field('N');
+    s.status(n.arrival);
+    //  We never pass the perpendicular, since we declare arrival before reaching this point
+    s.status(false);
+    s.field(origin, 1);
+    s.field(units);
+    s.field(destination, 6);
+    s.field(present, 1);
+    s.field(units);
+    s.field(steer, 1);
+    s.field(units);
+    return s;
+}
+
+nmea_sentence nmea_xte(const nav_solution &n)
+{
+    nmea_sentence s("EC", "XTE");
+    s.status(true); // loran blink
+    s.status(true); // loran cycle lock
+    s.field(fabs(n.xte), 3);
+    s.field(n.xte < 0 ? 'L' : 'R');
+    s.field('N');
+    return s;
+}
@@ -0,0 +1,103 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#ifndef _NMEA_SENTENCE_H_
+#define _NMEA_SENTENCE_H_
+
+#include <time.h>
+#include <limits.h>
+
+#include <wx/string.h>
+
+// an nmea 0183 sentence formatted field by field into a fixed buffer, so
+// sending the output allocates nothing until it is handed to opencpn
+class nmea_sentence
+{
+public:
+    nmea_sentence(const char *talker, const char *type);
+
+    void field(const char *s);
+    void field(char c);
+    void field(const wxString &s, int max);  // at most max ascii characters
+    void field(double v, int decimals);      // empty if nan
+    void status(bool valid) { field(valid ? 'A' : 'V'); }
+    void latitude(double lat);               // ddmm.mmmm,N
+    void longitude(double lon);              // dddmm.mmmm,E
+
+    // appends the checksum and line ending, NULL if it did not fit
+    const char *finish();
+
+    // longest sentence allowed, from $ to the line ending
+    static const int max_length = 82;
+
+private:
+    void put(char c) {
+        if(m_len < max_length)
+            m_buf[m_len++] = c;
+        else
+            m_overflow = true;
+    }
+    void digits(unsigned long long v, int width);
+    void degrees(double v, int width);
+
+    char m_buf[max_length + 1];
+    int m_len;
+    bool m_overflow;
+};
+
+// hhmmss and ddmmyy fields of a utc time, converted again only when the
+// second changes and the date only when the day does
+class utc_fields
+{
+public:
+    utc_fields() : m_time(-1), m_day(LONG_MIN) {}
+
+    void set(time_t t);
+    const char *time() const { return m_hhmmss; }
+    const char *date() const { return m_ddmmyy; }
+
+private:
+    time_t m_time;
+    long m_day; // since the epoch
+    char m_hhmmss[7], m_ddmmyy[7];
+};
+
+struct nav_solution;
+class waypoint;
+
+// the sentences sent for one navigation update, built here rather than by
+// the plugin so their fields can be checked without opencpn
+nmea_sentence nmea_rmb(const nav_solution &n, const wxString &origin,
+                       const waypoint &destination, double sog);
+// utc set to t, the time of the position
+nmea_sentence nmea_rmc(utc_fields &utc, time_t t, double lat, double lon,
+                       double sog, double cog, double variation);
+// the bearings are magnetic unless the declination is nan
+nmea_sentence nmea_apb(const nav_solution &n, const wxString &destination,
+                       double declination);
+nmea_sentence nmea_xte(const nav_solution &n);
+
+#endif
@@ -0,0 +1,367 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#include <math.h>
+#include <algorithm>
+
+#include "route.h"
+
+waypoint::waypoint(double lat, double lon, wxString n, wxString guid,
+                   double ar, double ab)
+    : wp(lat, lon), name(n), GUID(guid), arrival_radius(ar), arrival_bearing(ab), index(-1)
+{
+}
+
+void ap_route::clear()
+{
+    start = 0;
+    lat.clear();
+    lon.clear();
+    arrival_radius.clear();
+    arrival_bearing.clear();
+    name.clear();
+    GUID.clear();
+    id.clear();
+    guid_index.clear();
+
+    points.clear();
+    segments.clear();
+    leg_bearing.clear();
+    leg_distance.clear();
+    route_distance.clear();
+    arrival_normal.clear();
+    segment_arrays.resize(0);
+    frame.valid = false;
+    projected.clear();
+}
+
+void ap_route::push_back(const waypoint &w)
+{
+    lat.push_back(w.lat);
+    lon.push_back(w.lon);
+    arrival_radius.push_back(w.arrival_radius);
+    arrival_bearing.push_back(w.arrival_bearing);
+    name.push_back(w.name);
+    GUID.push_back(w.GUID);
+    // a repeated guid keeps the id of its first occurrence
+    id.push_back(w.GUID.IsEmpty() ? -1 : guid_index.emplace(w.GUID, size() - 1).first->second);
+}
+
+void ap_route::set(int i, const waypoint &w)
+{
+    lat[i] = w.lat;
+    lon[i] = w.lon;
+    arrival_radius[i] = w.arrival_radius;
+    arrival_bearing[i] = w.arrival_bearing;
+    name[i] = w.name;
+    if(GUID[i] != w.GUID) {
+        GUID[i] = w.GUID;
+        intern(); // rare, so simply intern them all again
+    }
+}
+
+void ap_route::intern()
+{
+    guid_index.clear();
+    for(int i=0; i<size(); i++)
+        id[i] = GUID[i].IsEmpty() ? -1 : guid_index.emplace(GUID[i], i).first->second;
+}
+
+int ap_route::find(const wxString &guid, int from) const
+{
+    std::unordered_map<wxString, int, wxStringHash, wxStringEqual>::const_iterator it = guid_index.find(guid);
+    if(it == guid_index.end())
+        return -1;
+    // only a guid repeated in the route (closed loop) needs the scan
+    for(int i = it->second < from ? from : it->second; i < size(); i++)
+        if(id[i] == it->second)
+            return i;
+    return -1;
+}
+
+computation_mc::xy ap_route::project(wp &p)
+{
+    if(!frame.valid || frame.drifted(p)) {
+        frame.anchor(p);
+        projected.resize(size());
+        for(int i=start; i<size(); i++) {
+            wp q = point(i);
+            projected[i] = frame.project(q);
+        }
+    }
+    return frame.project(p);
+}
+
+waypoint ap_route::at(int i) const
+{
+    waypoint w(lat[i], lon[i], name[i], GUID[i], arrival_radius[i], arrival_bearing[i]);
+    w.index = i;
+    return w;
+}
+
+void segment_index::box::init(computation_gc::vector &v)
+{
+    min[0] = max[0] = v.x;
+    min[1] = max[1] = v.y;
+    min[2] = max[2] = v.z;
+}
+
+void segment_index::box::grow(computation_gc::vector &v)
+{
+    double c[3] = {v.x, v.y, v.z};
+    for(int i=0; i<3; i++) {
+        min[i] = std::min(min[i], c[i]);
+        max[i] = std::max(max[i], c[i]);
+    }
+}
+
+void segment_index::box::grow(box &b)
+{
+    for(int i=0; i<3; i++) {
+        min[i] = std::min(min[i], b.min[i]);
+        max[i] = std::max(max[i], b.max[i]);
+    }
+}
+
+void segment_index::box::expand(double h)
+{
+    for(int i=0; i<3; i++)
+        min[i] -= h, max[i] += h;
+}
+
+// squared distance from c to the box
+double segment_index::box::distance2(computation_gc::vector &c)
+{
+    double v[3] = {c.x, c.y, c.z}, d2 = 0;
+    for(int i=0; i<3; i++) {
+        double d = std::max(std::max(min[i] - v[i], v[i] - max[i]), 0.0);
+        d2 += d*d;
+    }
+    return d2;
+}
+
+static const int leaf_size = 4;
+
+void segment_index::build(ap_route &route)
+{
+    clear();
+    int n = route.size() - 1;
+    if(n <= route.start)
+        return;
+
+    // box around each segment, the arc bulges from its chord
+    // by at most 1 - cos(angle/2)
+    std::vector<box> boxes(n);
+    for(int i=route.start; i<n; i++) {
+        computation_gc::segment &s = route.segments[i];
+        boxes[i].init(s.v0);
+        boxes[i].grow(s.v1);
+        boxes[i].expand(1 - sqrt((1 + s.d)/2));
+        order.push_back(i);
+    }
+
+    nodes.reserve(2*order.size()/leaf_size + 1);
+    build_node(boxes, 0, order.size());
+}
+
+int segment_index::build_node(std::vector<box> &boxes, int first, int count)
+{
+    int index = nodes.size();
+    nodes.push_back(node());
+    node n;
+    n.first = first, n.count = count;
+    n.left = n.right = -1;
+    n.b = boxes[order[first]];
+    for(int i=first+1; i<first+count; i++)
+        n.b.grow(boxes[order[i]]);
+
+    if(count > leaf_size) {
+        // split at the median along the longest axis
+        int axis = 0;
+        for(int i=1; i<3; i++)
+            if(n.b.max[i] - n.b.min[i] > n.b.max[axis] - n.b.min[axis])
+                axis = i;
+
+        int mid = count / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + mid,
+                         order.begin() + first + count,
+                         [&boxes, axis](int a, int b) {
+                             return boxes[a].min[axis] + boxes[a].max[axis] <
+                                 boxes[b].min[axis] + boxes[b].max[axis]; });
+        n.count = 0;
+        n.left = build_node(boxes, first, mid);
+        n.right = build_node(boxes, first + mid, count - mid);
+    }
+    nodes[index] = n;
+    return index;
+}
+
+static double chord2(computation_gc::vector &a, computation_gc::vector &b)
+{
+    double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return dx*dx + dy*dy + dz*dz;
+}
+
+int segment_index::nearest(ap_route &route, computation_gc::vector &c, int start)
+{
+    int n = route.size() - 1;
+    if(n - route.start < min_segments)
+        return computation_gc::closest_seg_batch(c, route.segment_arrays, start, n);
+
+    if(nodes.empty())
+        build(route);
+
+    int best = -1;
+    double best_d2 = INFINITY;
+    std::vector<int> stack;
+    if(!nodes.empty())
+        stack.push_back(0);
+    while(!stack.empty()) {
+        node &n = nodes[stack.back()];
+        stack.pop_back();
+        if(n.b.distance2(c) > best_d2)
+            continue;
+
+        if(n.count) {
+            for(int i=n.first; i<n.first+n.count; i++) {
+                int seg = order[i];
+                if(seg < start)
+                    continue;
+                computation_gc::vector v = computation_gc::closest_vector_seg(c, route.segments[seg]);
+                double d2 = chord2(c, v);
+                // prefer the later segment on ties, as the linear search does
+                if(d2 < best_d2 || (d2 == best_d2 && seg > best)) {
+                    best_d2 = d2;
+                    best = seg;
+                }
+            }
+            continue;
+        }
+
+        // visit the closer child first
+        double dl = nodes[n.left].b.distance2(c), dr = nodes[n.right].b.distance2(c);
+        if(dl < dr) {
+            stack.push_back(n.right);
+            stack.push_back(n.left);
+        } else {
+            stack.push_back(n.left);
+            stack.push_back(n.right);
+        }
+    }
+    return best;
+}
+
+void segment_index::within(ap_route &route, computation_gc::vector &c, double chord, int start,
+                           std::vector<int> &segs)
+{
+    if(nodes.empty())
+        build(route);
+
+    segs.clear();
+    double chord_2 = chord*chord;
+    std::vector<int> stack;
+    if(!nodes.empty())
+        stack.push_back(0);
+    while(!stack.empty()) {
+        node &n = nodes[stack.back()];
+        stack.pop_back();
+        if(n.b.distance2(c) > chord_2)
+            continue;
+
+        if(n.count) {
+            for(int i=n.first; i<n.first+n.count; i++)
+                if(order[i] >= start)
+                    segs.push_back(order[i]);
+        } else {
+            stack.push_back(n.left);
+            stack.push_back(n.right);
+        }
+    }
+    std::sort(segs.begin(), segs.end());
+}
+
+const double route_cursor::jump_distance = 1852;
+
+void eta_schedule::update(int next_wp, double along, double sog, const wxDateTime &now)
+{
+    next = next_wp;
+    along_track = along;
+    speed = sog;
+    time = now;
+}
+
+wxDateTime eta_schedule::eta(ap_route &route, int i) const
+{
+    double hours = std::max(distance(route, i), 0.0) / speed;
+    return time + wxTimeSpan::Seconds((wxLongLong)(hours * 3600));
+}
+
+bool route_refresh::modified(const wxString &message_id, const wxString &guid,
+                             const wxString &active_guid, const ap_route &route)
+{
+    if(active_guid.IsEmpty())
+        return false;
+    bool active = message_id == "OCPN_RTE_MODIFIED" ? guid == active_guid : route.find(guid) >= 0;
+    if(active)
+        changed = true;
+    return active;
+}
+
+bool route_refresh::due(const wxDateTime &now)
+{
+    // until a response is received, on every tick
+    if(!changed && time.IsValid() && (now - time).GetSeconds() <= poll)
+        return false;
+    changed = false;
+    return true;
+}
+
+int route_refresh::changes(const std::vector<waypoint> &received,
+                           const std::vector<waypoint> &last, int start,
+                           std::vector<bool> &dirty)
+{
+    int n = received.size();
+    if(n != (int)last.size())
+        return -1;
+
+    dirty.assign(n, false);
+    int first = n;
+    for(int i=0; i<n; i++) {
+        const waypoint &a = received[i], &b = last[i];
+        // the arrival bearing follows the previous waypoint,
+        // except for the first which follows the boat
+        dirty[i] = a.lat != b.lat || a.lon != b.lon || a.name != b.name || a.GUID != b.GUID ||
+            a.arrival_radius != b.arrival_radius ||
+            (i > 0 && a.arrival_bearing != b.arrival_bearing);
+        if(dirty[i] && first == n)
+            first = i;
+    }
+
+    // the start waypoint may have been moved to the intercept
+    if(first < n && first <= start)
+        return -1;
+    return first;
+}
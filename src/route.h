@@ -0,0 +1,226 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#ifndef _ROUTE_H_
+#define _ROUTE_H_
+
+#include <vector>
+#include <unordered_map>
+
+#include <wx/string.h>
+#include <wx/hashmap.h>
+#include <wx/datetime.h>
+
+#include "computation.h"
+
+class waypoint : public wp {
+public:
+    waypoint() : index(-1) {}
+    waypoint(double lat, double lon) : wp(lat, lon), index(-1) {}
+    waypoint(double lat, double lon, wxString name, wxString guid, double ar, double ab);
+
+    wxString name, GUID;
+    double arrival_radius;
+    double arrival_bearing;
+    int index; // position in the route, -1 if not a route point
+};
+
+// the route is stored as arrays rather than a list of waypoints so
+// the per tick computations walk contiguous memory.  Waypoints before
+// start were already passed when the route was received and are skipped.
+class ap_route
+{
+public:
+    ap_route() : start(0) {}
+
+    void clear();
+    void push_back(const waypoint &w);
+    void set(int i, const waypoint &w);
+    void intern();
+
+    int size() const { return lat.size(); }
+    bool empty() const { return start >= size(); }
+    wp point(int i) const { return wp(lat[i], lon[i]); }
+    waypoint at(int i) const;
+    // index of the first waypoint from index from with guid, -1 if none
+    int find(const wxString &guid, int from = 0) const;
+
+    int start;
+    std::vector<double> lat, lon, arrival_radius, arrival_bearing;
+    // side table, not needed by the per tick computations
+    std::vector<wxString> name, GUID;
+    // GUIDs interned to the index of their first occurrence so identity
+    // checks compare integers, -1 for waypoints without a GUID
+    std::vector<int> id;
+    std::unordered_map<wxString, int, wxStringHash, wxStringEqual> guid_index;
+
+    // geometry compiled once when the route is received,
+    // segment i joins waypoint i and i+1
+    std::vector<computation_gc::vector> points;
+    std::vector<computation_gc::segment> segments;
+    std::vector<double> leg_bearing, leg_distance;
+    // distance along the route from the first active waypoint to each waypoint
+    std::vector<double> route_distance;
+    // distance along the route from waypoint i to the end
+    double remaining(int i) const { return route_distance.back() - route_distance[i]; }
+    // normal of great circle through each waypoint along its arrival bearing
+    std::vector<computation_gc::vector> arrival_normal;
+    // points and segments again as coordinate arrays for closest_seg_batch
+    computation_gc::segment_array segment_arrays;
+
+    // points projected in the mercator frame, only kept up to date by project()
+    computation_mc::frame frame;
+    std::vector<computation_mc::xy> projected;
+    // p in the mercator frame, anchoring the frame at p and projecting
+    // the points again the first time or when p drifted from the anchor
+    computation_mc::xy project(wp &p);
+};
+
+// bounding volume hierarchy over the great circle route segments on the
+// unit sphere, answers nearest segment and circle queries in log time
+class segment_index
+{
+public:
+    void clear() { nodes.clear(); order.clear(); }
+    bool empty() const { return nodes.empty(); }
+    void build(ap_route &route);
+
+    // nearest segment to c, ignoring segments before start.
+    // Small routes are searched with closest_seg_batch instead
+    static const int min_segments = 64;
+    int nearest(ap_route &route, computation_gc::vector &c, int start);
+    // segments that may have a point within chord distance of c, sorted and
+    // ignoring segments before start.  All that do are included, along
+    // with others near them, for the caller to test
+    void within(ap_route &route, computation_gc::vector &c, double chord, int start,
+                std::vector<int> &segs);
+
+private:
+    struct box
+    {
+        double min[3], max[3];
+        void init(computation_gc::vector &v);
+        void grow(computation_gc::vector &v);
+        void grow(box &b);
+        void expand(double h);
+        double distance2(computation_gc::vector &c);
+    };
+
+    struct node
+    {
+        box b;
+        int first, count; // leaf range in order
+        int left, right;  // children if count is zero
+    };
+
+    int build_node(std::vector<box> &boxes, int first, int count);
+
+    std::vector<node> nodes;
+    std::vector<int> order;
+};
+
+// remembers progress along the route so the per tick search only
+// considers segments near the last position
+struct route_cursor
+{
+    route_cursor() { reset(); }
+    void reset() { segment = -1; along_track = 0; }
+    bool valid(ap_route &route) { return segment >= route.start && segment < route.size() - 1; }
+    // distances measured with the geometry policy G, as the legs are
+    template<class G> bool jumped(wp &p) {
+        double brg, dist;
+        G::distance_bearing(position.lat, position.lon, p.lat, p.lon, &brg, &dist);
+        return dist * 1852 > jump_distance;
+    }
+    template<class G> void set(ap_route &route, int seg, wp &p, wp &w) {
+        segment = seg;
+        position = p;
+
+        // add the partial distance along the active segment
+        double brg, dist;
+        wp p0 = route.point(seg);
+        G::distance_bearing(p0.lat, p0.lon, w.lat, w.lon, &brg, &dist);
+        along_track = route.route_distance[seg] + dist;
+    }
+
+    int segment;          // active segment
+    double along_track;   // route distance from the first waypoint to w
+    wp position;          // position of the boat when last set
+
+    // distance the boat may move between updates before a full search (meters)
+    static const double jump_distance;
+};
+
+// arrival times at the waypoints ahead.  Only the position along the route
+// and the speed are kept, each entry is evaluated when needed from the
+// route distances so updating costs the same for any route length.
+struct eta_schedule
+{
+    eta_schedule() { reset(); }
+    void reset() { next = -1; speed = 0; }
+    void update(int next_wp, double along, double sog, const wxDateTime &now);
+    bool valid(ap_route &route, int i) const {
+        return next >= route.start && i >= next && i < route.size() && speed > 0;
+    }
+    // distance to waypoint i along the route (nm)
+    double distance(ap_route &route, int i) const { return route.route_distance[i] - along_track; }
+    wxDateTime eta(ap_route &route, int i) const;
+
+    int next;           // first waypoint ahead
+    double along_track; // route distance from the first waypoint to the boat
+    double speed;       // knots
+    wxDateTime time;    // of the update
+};
+
+// when the active route is requested from opencpn again, on the gui
+// thread.  Notifications that it changed are requested once on the next
+// tick however many arrive, and changes not notified are still picked up
+// by polling slowly.
+struct route_refresh
+{
+    route_refresh() : changed(false) {}
+
+    // OCPN_RTE_MODIFIED with the guid of a route or OCPN_WPT_MODIFIED with
+    // the guid of a waypoint, true if it changed the active route
+    bool modified(const wxString &message_id, const wxString &guid,
+                  const wxString &active_guid, const ap_route &route);
+    // on each tick, true when the route is to be requested
+    bool due(const wxDateTime &now);
+    void received(const wxDateTime &now) { time = now; }
+
+    // the waypoints of a route received again that differ from the last,
+    // so only those are compiled.  Returns the first that changed, the
+    // size if none did, or -1 if the route must be compiled from scratch
+    static int changes(const std::vector<waypoint> &received,
+                       const std::vector<waypoint> &last, int start,
+                       std::vector<bool> &dirty);
+
+    bool changed;    // notified the active route was modified
+    wxDateTime time; // a response was last received
+    static const int poll = 60; // seconds
+};
+
+#endif
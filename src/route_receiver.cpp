@@ -0,0 +1,188 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#include <string_view>
+
+#include "route_receiver.h"
+
+route_receiver::result route_receiver::parse(const char *body, size_t len,
+                                             const wxString &request_guid, route_response &r)
+{
+    // the active route is polled, most responses repeat the last one
+    m_received_hash = std::hash<std::string_view>()(std::string_view(body, len));
+    if(m_received_hash == m_hash && request_guid == m_guid)
+        return REPEATED;
+
+    // routes can be large, the waypoints are decoded without a json tree
+    if(!r.parse(body, len))
+        return FAILED;
+    if(r.error || r.GUID != request_guid)
+        return IGNORED;
+    return RECEIVED;
+}
+
+route_receiver::result route_receiver::apply(route_response &r, wp boat, double cog, bool moving)
+{
+    std::vector<waypoint> &received = r.waypoints;
+    int size = received.size();
+    if(size < 2) {
+        // cleared, so whatever is received next is compiled
+        m_route.clear();
+        m_index.clear();
+        reset();
+        return ENDED;
+    }
+
+    double lat0 = boat.lat, lon0 = boat.lon;
+    for(int i=0; i<size; i++) {
+        waypoint &w = received[i];
+        geometry.distance_bearing(lat0, lon0, w.lat, w.lon, &w.arrival_bearing, 0);
+
+        // set arrival bearing to current course for first waypoint
+        if(i == 0 && moving)
+            w.arrival_bearing = cog;
+        lat0 = w.lat, lon0 = w.lon;
+    }
+
+    // the same route again, keep the progress along it
+    result res = NEW;
+    if(r.GUID == m_guid)
+        res = update(received) ? (dirty.empty() ? UNCHANGED : UPDATED) : NEW;
+
+    if(res == NEW) {
+        m_route.clear();
+        for(int i=0; i<size; i++)
+            m_route.push_back(received[i]);
+        m_guid = r.GUID;
+        dirty.clear();
+        compile();
+    }
+    m_last.swap(received);
+    m_hash = m_received_hash;
+    return res;
+}
+
+void route_receiver::compile()
+{
+    int n = m_route.size();
+    m_route.points.resize(n);
+    m_route.arrival_normal.resize(n);
+    m_route.segments.resize(n > 0 ? n-1 : 0);
+    m_route.leg_bearing.resize(n > 0 ? n-1 : 0);
+    m_route.leg_distance.resize(n > 0 ? n-1 : 0);
+    m_route.route_distance.resize(n);
+    m_route.segment_arrays.resize(n);
+
+    m_index.clear();
+    for(int i = m_route.start; i < n; i++)
+        compile_point(i);
+
+    for(int i = m_route.start; i < n-1; i++)
+        compile_segment(i);
+    compile_distance(m_route.start);
+}
+
+// apply the route received again to the compiled route, compiling only the
+// waypoints that changed, dirty is left empty if none did.  Returns false
+// if it must be compiled from scratch.
+bool route_receiver::update(std::vector<waypoint> &received)
+{
+    int n = received.size();
+    if(n != m_route.size())
+        return false;
+
+    int first = route_refresh::changes(received, m_last, m_route.start, dirty);
+    if(first < 0)
+        return false;
+    if(first == n) {
+        dirty.clear();
+        return true; // unchanged
+    }
+
+    for(int i = first; i < n; i++)
+        if(dirty[i])
+            m_route.set(i, received[i]);
+
+    // changes() only returns waypoints after the start, so segment i-1
+    // and the distance to first-1 are compiled
+    m_index.clear();
+    for(int i = first; i < n; i++) {
+        if(!dirty[i])
+            continue;
+        compile_point(i);
+        compile_segment(i-1);
+        if(i < n-1)
+            compile_segment(i);
+    }
+    compile_distance(first-1);
+    return true;
+}
+
+// recompile after waypoint i was modified
+void route_receiver::compile_waypoint(int i)
+{
+    m_index.clear();
+    compile_point(i);
+    if(i > m_route.start)
+        compile_segment(i-1);
+    if(i < m_route.size()-1)
+        compile_segment(i);
+    compile_distance(i > m_route.start ? i-1 : m_route.start);
+}
+
+void route_receiver::compile_point(int i)
+{
+    wp p = m_route.point(i);
+    computation_gc::vector v = computation_gc::ll2v(p);
+    m_route.points[i] = v;
+    m_route.segment_arrays.set_point(i, v);
+    if(m_route.frame.valid)
+        m_route.projected[i] = m_route.frame.project(p);
+
+    // great circle through the waypoint along its arrival bearing
+    double dlat, dlon;
+    geometry.position_bearing(p.lat, p.lon, m_route.arrival_bearing[i], 1, &dlat, &dlon);
+    wp b(dlat, dlon);
+    computation_gc::vector vb = computation_gc::ll2v(b);
+    m_route.arrival_normal[i] = computation_gc::segment(v, vb).n;
+}
+
+void route_receiver::compile_segment(int i)
+{
+    m_route.segments[i] = computation_gc::segment(m_route.points[i], m_route.points[i+1]);
+    m_route.segment_arrays.set_segment(i, m_route.segments[i]);
+    geometry.distance_bearing(m_route.lat[i], m_route.lon[i], m_route.lat[i+1], m_route.lon[i+1],
+                              &m_route.leg_bearing[i], &m_route.leg_distance[i]);
+}
+
+// accumulate leg distances from waypoint i to the end of the route
+void route_receiver::compile_distance(int i)
+{
+    if(i == m_route.start)
+        m_route.route_distance[i] = 0;
+    for(; i < m_route.size()-1; i++)
+        m_route.route_distance[i+1] = m_route.route_distance[i] + m_route.leg_distance[i];
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#ifndef _ROUTE_RECEIVER_H_
+#define _ROUTE_RECEIVER_H_
+
+#include <vector>
+
+#include <wx/string.h>
+
+#include "route.h"
+#include "route_response.h"
+
+// the distance, bearing and position along a bearing of the geometry
+// selected in the preferences (see geometry.h), as plain functions so
+// routes compile without the plugin
+struct route_geometry
+{
+    void (*distance_bearing)(double lat0, double lon0, double lat1, double lon1,
+                             double *brg, double *dist);
+    void (*position_bearing)(double lat0, double lon0, double brg, double dist,
+                             double *dlat, double *dlon);
+};
+
+// OCPN_ROUTE_RESPONSE applied to the route the navigation thread follows.
+// The active route is polled so most responses repeat the last one, and a
+// route edited while navigating only compiles the waypoints that changed.
+class route_receiver
+{
+public:
+    route_receiver(ap_route &route, segment_index &index)
+        : m_route(route), m_index(index), m_hash(0), m_received_hash(0) {}
+
+    enum result {
+        FAILED,    // not decoded, at error_offset of the response
+        IGNORED,   // an error or not the route requested
+        REPEATED,  // the same response as last time
+        RECEIVED,  // decoded, to apply
+        ENDED,     // fewer than two waypoints, the route was cleared
+        UNCHANGED, // the same waypoints
+        UPDATED,   // the waypoints in dirty changed and were compiled
+        NEW        // compiled from scratch from the first waypoint
+    };
+
+    // decode a response to the route requested, needs no lock
+    result parse(const char *body, size_t len, const wxString &request_guid,
+                 route_response &r);
+    // with the navigation mutex held.  The arrival bearing of each waypoint
+    // is from the previous one, for the first from the boat or along its
+    // course if moving
+    result apply(route_response &r, wp boat, double cog, bool moving);
+    // received again as new, when activated or deactivated
+    void reset() { m_guid = ""; }
+
+    // compile the route from its start, or again after waypoint i was set
+    void compile();
+    void compile_waypoint(int i);
+
+    route_geometry geometry;
+    std::vector<bool> dirty; // waypoints the last update changed
+
+private:
+    bool update(std::vector<waypoint> &received);
+    void compile_point(int i);
+    void compile_segment(int i);
+    void compile_distance(int i);
+
+    ap_route &m_route;
+    segment_index &m_index; // cleared when compiling, built on first use
+
+    // the route as last received, to apply only the changes when polled
+    wxString m_guid;
+    size_t m_hash, m_received_hash;
+    std::vector<waypoint> m_last;
+};
+
+#endif
@@ -0,0 +1,323 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include "route_response.h"
+
+static bool hex4(const char *&p, const char *end, unsigned int &u)
+{
+    if(end - p < 4)
+        return false;
+    u = 0;
+    for(int i=0; i<4; i++) {
+        char c = *p++;
+        u <<= 4;
+        if(c >= '0' && c <= '9')
+            u |= c - '0';
+        else if(c >= 'a' && c <= 'f')
+            u |= c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F')
+            u |= c - 'A' + 10;
+        else
+            return false;
+    }
+    return true;
+}
+
+static void utf8(std::string &s, unsigned int u)
+{
+    if(u < 0x80)
+        s.push_back(u);
+    else if(u < 0x800) {
+        s.push_back(0xc0 | (u >> 6));
+        s.push_back(0x80 | (u & 0x3f));
+    } else if(u < 0x10000) {
+        s.push_back(0xe0 | (u >> 12));
+        s.push_back(0x80 | ((u >> 6) & 0x3f));
+        s.push_back(0x80 | (u & 0x3f));
+    } else {
+        s.push_back(0xf0 | (u >> 18));
+        s.push_back(0x80 | ((u >> 12) & 0x3f));
+        s.push_back(0x80 | ((u >> 6) & 0x3f));
+        s.push_back(0x80 | (u & 0x3f));
+    }
+}
+
+bool route_response::parse(const char *json, size_t len)
+{
+    m_begin = m_p = json;
+    m_end = json + len;
+    // numbers are converted by strtod which expects the locale decimal point
+    m_point = *localeconv()->decimal_point;
+
+    error = false;
+    GUID = "";
+    waypoints.clear();
+    error_offset = -1;
+
+    if(!ws_is('{'))
+        return fail();
+    m_p++;
+    if(ws_is('}'))
+        return true;
+
+    for(;;) {
+        if(!ws_is('"') || !string(&m_key) || !ws_is(':'))
+            return fail();
+        m_p++;
+
+        if(m_key == "waypoints" && ws_is('[')) {
+            m_p++;
+            if(ws_is(']'))
+                m_p++;
+            else for(;;) {
+                if(!waypoint_object())
+                    return fail();
+                if(ws_is(',')) {
+                    m_p++;
+                    continue;
+                }
+                if(!ws_is(']'))
+                    return fail();
+                m_p++;
+                break;
+            }
+        } else {
+            double d;
+            if(!value(d, m_key == "GUID" ? &m_str : NULL, 0))
+                return fail();
+            if(m_key == "error")
+                error = d != 0;
+            else if(m_key == "GUID")
+                GUID = wxString::FromUTF8(m_str.data(), m_str.size());
+        }
+
+        if(ws_is(',')) {
+            m_p++;
+            continue;
+        }
+        if(!ws_is('}'))
+            return fail();
+        m_p++;
+        return true;
+    }
+}
+
+bool route_response::waypoint_object()
+{
+    if(!ws_is('{'))
+        return false;
+    m_p++;
+
+    double lat = 0, lon = 0, arrival_radius = 0;
+    wxString name, guid;
+    if(!ws_is('}')) for(;;) {
+        if(!ws_is('"') || !string(&m_key) || !ws_is(':'))
+            return false;
+        m_p++;
+
+        double d;
+        bool str = m_key == "Name" || m_key == "GUID";
+        if(!value(d, str ? &m_str : NULL, 0))
+            return false;
+        if(m_key == "lat")
+            lat = d;
+        else if(m_key == "lon")
+            lon = d;
+        else if(m_key == "ArrivalRadius")
+            arrival_radius = d;
+        else if(m_key == "Name")
+            name = wxString::FromUTF8(m_str.data(), m_str.size());
+        else if(m_key == "GUID")
+            guid = wxString::FromUTF8(m_str.data(), m_str.size());
+
+        if(ws_is(',')) {
+            m_p++;
+            continue;
+        }
+        if(!ws_is('}'))
+            return false;
+        break;
+    }
+    m_p++;
+
+    waypoints.push_back(waypoint(lat, lon, name, guid, arrival_radius, 0));
+    return true;
+}
+
+// any value, numbers and literals are returned in d and strings in s if
+// given, like the json library converts them.  Objects and arrays are skipped
+bool route_response::value(double &d, std::string *s, int depth)
+{
+    d = 0;
+    if(s)
+        s->clear(); // null or any value not a string is empty
+    if(ws_is('"'))
+        return string(s);
+    if(m_p == m_end)
+        return false;
+
+    switch(*m_p) {
+    case '{': case '[': return skip(depth);
+    case 't': d = 1; return literal("true");
+    case 'f': return literal("false");
+    case 'n': return literal("null");
+    default: return number(d);
+    }
+}
+
+// skip the object or array at m_p
+bool route_response::skip(int depth)
+{
+    if(depth > 64)
+        return false;
+
+    char close = *m_p++ == '{' ? '}' : ']';
+    if(ws_is(close)) {
+        m_p++;
+        return true;
+    }
+
+    for(;;) {
+        if(close == '}') {
+            if(!ws_is('"') || !string(NULL) || !ws_is(':'))
+                return false;
+            m_p++;
+        }
+
+        double d;
+        if(!value(d, NULL, depth+1))
+            return false;
+
+        if(ws_is(',')) {
+            m_p++;
+            continue;
+        }
+        if(!ws_is(close))
+            return false;
+        m_p++;
+        return true;
+    }
+}
+
+// the string at m_p unescaped to s if given
+bool route_response::string(std::string *s)
+{
+    if(s)
+        s->clear();
+    m_p++;
+    for(;;) {
+        const char *run = m_p;
+        while(m_p < m_end && *m_p != '"' && *m_p != '\\')
+            m_p++;
+        if(s)
+            s->append(run, m_p);
+        if(m_p == m_end)
+            return false;
+        if(*m_p++ == '"')
+            return true;
+
+        if(m_p == m_end)
+            return false;
+        char c = *m_p++;
+        unsigned int u;
+        switch(c) {
+        case '"': case '\\': case '/': break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u':
+            if(!hex4(m_p, m_end, u))
+                return false;
+            if(u >= 0xd800 && u < 0xdc00) {
+                // surrogate pair
+                unsigned int l;
+                if(m_end - m_p < 2 || m_p[0] != '\\' || m_p[1] != 'u')
+                    return false;
+                m_p += 2;
+                if(!hex4(m_p, m_end, l) || l < 0xdc00 || l >= 0xe000)
+                    return false;
+                u = 0x10000 + ((u - 0xd800) << 10) + (l - 0xdc00);
+            }
+            if(s)
+                utf8(*s, u);
+            continue;
+        default:
+            return false;
+        }
+        if(s)
+            s->push_back(c);
+    }
+}
+
+bool route_response::number(double &d)
+{
+    // copied so the decimal point can be replaced for strtod
+    char buf[64];
+    int n = 0;
+    while(m_p < m_end && n < (int)sizeof buf - 1) {
+        char c = *m_p;
+        if(!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+            break;
+        buf[n++] = c == '.' ? m_point : c;
+        m_p++;
+    }
+    if(n == 0)
+        return false;
+    buf[n] = 0;
+
+    char *e;
+    d = strtod(buf, &e);
+    return e == buf + n;
+}
+
+bool route_response::literal(const char *l)
+{
+    size_t n = strlen(l);
+    if((size_t)(m_end - m_p) < n || memcmp(m_p, l, n))
+        return false;
+    m_p += n;
+    return true;
+}
+
+// skip whitespace, true if c follows
+bool route_response::ws_is(char c)
+{
+    while(m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r'))
+        m_p++;
+    return m_p < m_end && *m_p == c;
+}
+
+bool route_response::fail()
+{
+    error_offset = m_p - m_begin;
+    return false;
+}
@@ -0,0 +1,66 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#ifndef _ROUTE_RESPONSE_H_
+#define _ROUTE_RESPONSE_H_
+
+#include <string>
+#include <vector>
+
+#include "route.h"
+
+// OCPN_ROUTE_RESPONSE decoded in a single pass over the utf-8 message.
+// The waypoints are stored as they are read instead of building a json
+// tree first, so large routes need neither the tree nor the lookups of
+// each waypoint member by name.  Members not used are skipped.
+class route_response
+{
+public:
+    route_response() : error(false), error_offset(-1) {}
+
+    bool parse(const char *json, size_t len);
+
+    bool error;                       // "error" member of the response
+    wxString GUID;
+    std::vector<waypoint> waypoints;  // arrival bearings are not set
+    int error_offset;                 // where parsing failed
+
+private:
+    bool value(double &d, std::string *s, int depth);
+    bool skip(int depth);
+    bool string(std::string *s);
+    bool number(double &d);
+    bool literal(const char *l);
+    bool waypoint_object();
+    bool ws_is(char c);
+    bool fail();
+
+    const char *m_begin, *m_p, *m_end;
+    char m_point;             // decimal point of the C locale
+    std::string m_key, m_str; // reused buffers
+};
+
+#endif
@@ -0,0 +1,315 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+// the polynomial trig of computation_gc_fast against the libm computations
+// on random positions over the globe, the ellipsoid distance and bearing
+// of APR_ll_gc_ll_reverse against the formula it was rewritten from, and
+// the time of each
+
+#include <math.h>
+#include <algorithm>
+
+#include "computation.h"
+#include "georef.h"
+#include "test.h"
+
+static const double earth_radius = 6378137.0; // meters
+
+// random position with the same density over the whole sphere
+static wp random_wp()
+{
+    return wp(asin(uniform(-1, 1)) * 180 / M_PI, uniform(-180, 180));
+}
+
+// position at about min to dist meters from p in a random direction
+static wp random_near(wp &p, double dist, double min = 0)
+{
+    double brg = uniform(0, 2*M_PI), d = uniform(min, dist) / earth_radius;
+    double lat = p.lat * M_PI / 180, lon = p.lon * M_PI / 180;
+    double lat1 = asin(sin(lat)*cos(d) + cos(lat)*sin(d)*cos(brg));
+    double lon1 = lon + atan2(sin(brg)*sin(d)*cos(lat), cos(d) - sin(lat)*sin(lat1));
+    return wp(lat1 * 180 / M_PI, remainder(lon1 * 180 / M_PI, 360));
+}
+
+// meters between two positions, the chord so it stays exact for small errors
+static double error(wp &a, wp &b)
+{
+    computation_gc::vector u = computation_gc::ll2v(a), v = computation_gc::ll2v(b);
+    computation_gc::vector d(u.x - v.x, u.y - v.y, u.z - v.z);
+    return d.norm() * earth_radius;
+}
+
+static double error(computation_gc::vector &a, computation_gc::vector &b)
+{
+    computation_gc::vector d(a.x - b.x, a.y - b.y, a.z - b.z);
+    return d.norm() * earth_radius;
+}
+
+template<typename F> static F adjlon(F lon)
+{
+    if(fabs(lon) <= 3.14159265359)
+        return lon;
+    lon += F(M_PI);
+    lon -= 2*F(M_PI) * floor(lon / (2*F(M_PI)));
+    return lon - F(M_PI);
+}
+
+// APR_ll_gc_ll_reverse as it was before the wgs84 terms were set up once
+// and the reduced latitudes taken as half angles: the Andoyer-Lambert
+// inverse through atan(onef * tan(phi)).  Coincident positions give nan,
+// they were left unset.
+template<typename F> static void reference_reverse(double lat1, double lon1, double lat2, double lon2,
+                                                   double *bearing, double *dist)
+{
+    using std::atan; using std::tan; using std::sin; using std::cos; using std::acos;
+    using std::atan2; using std::sqrt; using std::fabs; using std::floor;
+    const F deg = F(M_PI) / 180;
+    F f = 1 / F(WGSinvf), a = WGS84_semimajor_axis_meters;
+    F es = 2 * f - f * f, onef = sqrt(1 - es), geod_f = 1 - onef;
+    F f2 = geod_f/2, f4 = geod_f/4, f64 = geod_f*geod_f/64;
+
+    F th1 = atan(onef * tan(lat1 * deg)), th2 = atan(onef * tan(lat2 * deg));
+    F thm = (th1 + th2) / 2, dthm = (th2 - th1) / 2;
+    F dlam = adjlon((F(lon2) - lon1) * deg), dlamm = dlam / 2;
+    if(fabs(dlam) < 1e-12 && fabs(dthm) < 1e-12) {
+        *bearing = *dist = NAN;
+        return;
+    }
+    F sindlamm = sin(dlamm), costhm = cos(thm), sinthm = sin(thm);
+    F cosdthm = cos(dthm), sindthm = sin(dthm);
+    F L = sindthm * sindthm + (cosdthm * cosdthm - sinthm * sinthm) * sindlamm * sindlamm;
+    F cosd = 1 - L - L, d = acos(cosd);
+    F E = cosd + cosd, sind = sin(d);
+    F Y = sinthm * cosdthm;
+    Y *= (Y + Y) / (1 - L);
+    F T = sindthm * costhm;
+    T *= (T + T) / L;
+    F X = Y + T;
+    Y -= T;
+    T = d / sind;
+    F D = 4 * T * T, A = D * E, B = D + D;
+    F S = a * sind * (T - f4 * (T * X - Y) +
+                      f64 * (X * (A + (T - (A - E) / 2) * X) - Y * (B + E * Y) + D * X * Y));
+    F tandlammp = tan((dlam - (Y + Y - E * (4 - X)) / 4 *
+                       (f2 * T + f64 * (32 * T - (20 * T - A) * X - (B + 4) * Y)) *
+                       tan(dlam)) / 2);
+    F u = atan2(sindthm, tandlammp * costhm), v = atan2(cosdthm, tandlammp * sinthm);
+    F al12 = adjlon(2*F(M_PI) + v - u);
+    if(al12 < 0)
+        al12 += 2*F(M_PI);
+    *bearing = double(al12 / deg);
+    *dist = double(S / 1852);
+}
+
+// largest differences in meters, the bearing as the offset it makes at the
+// far end of the distance
+struct reverse_error {
+    double bearing = 0, dist = 0;
+    void add(double b, double d, double rb, double rd) {
+        bearing = std::max(bearing, fabs(remainder(b - rb, 360)) * DEGREE * rd * 1852);
+        dist = std::max(dist, fabs(d - rd) * 1852);
+    }
+};
+
+// differences from the previous formula evaluated in long double, of
+// APR_ll_gc_ll_reverse and of the previous formula in double, which loses
+// digits through acos(1 - 2L) when close and is ill conditioned near the
+// antipode
+static void compare_reverse(const wp &p0, const wp &p1, reverse_error &now, reverse_error &before)
+{
+    double b, d, rb, rd, lb, ld;
+    APR_ll_gc_ll_reverse(p0.lat, p0.lon, p1.lat, p1.lon, &b, &d);
+    reference_reverse<double>(p0.lat, p0.lon, p1.lat, p1.lon, &rb, &rd);
+    reference_reverse<long double>(p0.lat, p0.lon, p1.lat, p1.lon, &lb, &ld);
+    if(isnan(ld))
+        return;
+    now.add(b, d, lb, ld);
+    if(!isnan(rd))
+        before.add(rb, rd, lb, ld);
+}
+
+static void check_reverse(const char *name, reverse_error &now, reverse_error &before)
+{
+    printf("  %-20s bearing %8.2g m, before %8.2g  distance %8.2g m, before %8.2g\n",
+           name, now.bearing, before.bearing, now.dist, before.dist);
+    // no further from the formula than the double evaluation was
+    CHECK(now.bearing <= 2 * before.bearing + 1e-6);
+    CHECK(now.dist <= 2 * before.dist + 1e-6);
+}
+
+static void test_reverse(int n)
+{
+    printf("APR_ll_gc_ll_reverse from the previous formula in long double:\n");
+    reverse_error now, before;
+    for(int i=0; i<n; i++) {
+        // from a meter to across the globe
+        wp p = random_wp(), q = random_near(p, pow(10, uniform(0, 7)));
+        compare_reverse(p, q, now, before);
+    }
+    check_reverse("random pairs", now, before);
+
+    // a meter apart and along a meridian or a parallel
+    reverse_error near_now, near_before;
+    for(int i=0; i<n/10; i++) {
+        wp p = random_wp();
+        compare_reverse(p, random_near(p, 1), near_now, near_before);
+        compare_reverse(p, wp(std::min(std::max(p.lat + uniform(-1, 1), -90.), 90.), p.lon),
+                        near_now, near_before);
+        compare_reverse(p, wp(p.lat, remainder(p.lon + uniform(-1, 1), 360)), near_now, near_before);
+    }
+    check_reverse("close and aligned", near_now, near_before);
+
+    // to and from the poles, and 1 to 100 km from the antipode
+    reverse_error pole_now, pole_before, anti_now, anti_before;
+    for(int i=0; i<n/10; i++) {
+        wp pole(uniform(0, 1) < .5 ? 90 : -90, uniform(-180, 180)), r = random_wp();
+        compare_reverse(pole, r, pole_now, pole_before);
+        compare_reverse(r, pole, pole_now, pole_before);
+        wp p = random_wp(), a(-p.lat, remainder(p.lon + 180, 360));
+        compare_reverse(p, random_near(a, 1e5, 1e3), anti_now, anti_before);
+    }
+    check_reverse("poles", pole_now, pole_before);
+    check_reverse("near antipodal", anti_now, anti_before);
+
+    // closer to the antipode the solution is meaningless, but not nan
+    bool finite = true;
+    for(int i=0; i<n/10; i++) {
+        wp p = random_wp(), a(-p.lat, remainder(p.lon + 180, 360));
+        wp q = i ? random_near(a, 1e3) : a;
+        double b, d;
+        APR_ll_gc_ll_reverse(p.lat, p.lon, q.lat, q.lon, &b, &d);
+        finite = finite && isfinite(b) && isfinite(d);
+    }
+    CHECK(finite);
+
+    // coincident positions are 0, also across the date line
+    double b = NAN, d = NAN;
+    APR_ll_gc_ll_reverse(12.5, 45.25, 12.5, 45.25, &b, &d);
+    CHECK(b == 0 && d == 0);
+    b = d = NAN;
+    APR_ll_gc_ll_reverse(-40, 180, -40, -180, &b, &d);
+    CHECK(b == 0 && d == 0);
+
+    double t0 = time_ns(n, [&](int i) {
+        double b, d;
+        reference_reverse<double>(i * 1e-3, 10, 20, i * 1e-3, &b, &d);
+        test_sink = b + d;
+    });
+    double t1 = time_ns(n, [&](int i) {
+        double b, d;
+        APR_ll_gc_ll_reverse(i * 1e-3, 10, 20, i * 1e-3, &b, &d);
+        test_sink = b + d;
+    });
+    printf("APR_ll_gc_ll_reverse %6.1f ns  before %6.1f ns\n", t1, t0);
+}
+
+int main()
+{
+    const int n = 100000;
+    // the stated accuracy of computation_gc_fast
+    const double tolerance = 1e-4; // meters
+
+    double max_ll2v = 0, max_v2ll = 0, max_distance = 0, max_closest = 0;
+    double max_closest_seg = 0, max_intersect = 0;
+    int intersects = 0, disagree = 0;
+    for(int i=0; i<n; i++) {
+        wp p = random_wp();
+        computation_gc::vector v = computation_gc::ll2v(p), f = computation_gc_fast::ll2v(p);
+        max_ll2v = std::max(max_ll2v, error(v, f));
+
+        wp q = computation_gc::v2ll(v), r = computation_gc_fast::v2ll(v);
+        max_v2ll = std::max(max_v2ll, error(q, r));
+
+        // segments from a few meters to across the globe
+        double length = pow(10, uniform(1, 7));
+        wp p0 = random_near(p, length), p1 = random_near(p, length);
+        wp b = random_near(p, length);
+
+        // acos itself loses precision for the shortest distances
+        double d = computation_gc::distance(p0, p1), df = computation_gc_fast::distance(p0, p1);
+        if(d * earth_radius > 1000)
+            max_distance = std::max(max_distance, fabs(d - df) * earth_radius);
+
+        computation_gc::vector v0 = computation_gc::ll2v(p0), v1 = computation_gc::ll2v(p1);
+        if(v0.x == v1.x && v0.y == v1.y && v0.z == v1.z)
+            continue;
+        computation_gc::segment s(v0, v1);
+
+        wp c = computation_gc::closest(b, s.n), cf = computation_gc_fast::closest(b, s.n);
+        max_closest = std::max(max_closest, error(c, cf));
+
+        c = computation_gc::closest_seg(b, p0, p1, s);
+        cf = computation_gc_fast::closest_seg(b, p0, p1, s);
+        max_closest_seg = std::max(max_closest_seg, error(c, cf));
+
+        wp w, wf;
+        double dist = uniform(0, length);
+        bool hit = computation_gc::intersect_circle(b, dist, s, w);
+        bool hitf = computation_gc_fast::intersect_circle(b, dist, s, wf);
+        if(hit != hitf)
+            disagree++; // only allowed where the circle grazes an end or the segment
+        else if(hit) {
+            intersects++;
+            max_intersect = std::max(max_intersect, error(w, wf));
+        }
+    }
+
+    printf("max error over %d random positions (m):\n", n);
+    printf("  ll2v %g  v2ll %g  distance %g\n", max_ll2v, max_v2ll, max_distance);
+    printf("  closest %g  closest_seg %g  intersect_circle %g (%d hits, %d differ)\n",
+           max_closest, max_closest_seg, max_intersect, intersects, disagree);
+
+    CHECK(max_ll2v < tolerance);
+    CHECK(max_v2ll < tolerance);
+    CHECK(max_distance < tolerance);
+    CHECK(max_closest < tolerance);
+    CHECK(max_closest_seg < tolerance);
+    CHECK(max_intersect < tolerance);
+    CHECK(intersects > n/10);
+    CHECK(disagree < n/10000 + 1);
+
+    // time per call of each, on the same positions
+    std::vector<wp> ps(1024);
+    for(unsigned int i=0; i<ps.size(); i++)
+        ps[i] = random_wp();
+    const int m = 2000000, mask = ps.size() - 1;
+    computation_gc::vector n0 = computation_gc::ll2v(ps[0]), n1 = computation_gc::ll2v(ps[1]);
+    computation_gc::segment s(n0, n1);
+
+    double t0 = time_ns(m, [&](int i) { test_sink = computation_gc::ll2v(ps[i&mask]).x; });
+    double t1 = time_ns(m, [&](int i) { test_sink = computation_gc_fast::ll2v(ps[i&mask]).x; });
+    printf("ll2v              %6.1f ns  fast %6.1f ns\n", t0, t1);
+    t0 = time_ns(m, [&](int i) { test_sink = computation_gc::distance(ps[i&mask], ps[(i+1)&mask]); });
+    t1 = time_ns(m, [&](int i) { test_sink = computation_gc_fast::distance(ps[i&mask], ps[(i+1)&mask]); });
+    printf("distance          %6.1f ns  fast %6.1f ns\n", t0, t1);
+    t0 = time_ns(m, [&](int i) { test_sink = computation_gc::closest_seg(ps[i&mask], ps[0], ps[1], s).lat; });
+    t1 = time_ns(m, [&](int i) { test_sink = computation_gc_fast::closest_seg(ps[i&mask], ps[0], ps[1], s).lat; });
+    printf("closest_seg       %6.1f ns  fast %6.1f ns\n", t0, t1);
+
+    test_reverse(n);
+
+    return test_result("computation");
+}
@@ -0,0 +1,296 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+// latest<T> handing values from a writer thread to a reader thread,
+// dead_reckoning extrapolating a fix along straight and turning courses
+// against stepping the same course along great circles, and
+// sentence_schedule on a clock the test advances.
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <thread>
+
+#include "georef.h"
+#include "navigation.h"
+#include "test.h"
+
+typedef std::chrono::steady_clock::time_point time_point;
+
+// large enough that a torn copy would show
+struct sample
+{
+    uint64_t seq;
+    uint64_t check[31];
+};
+
+static void fill(sample &s, uint64_t seq)
+{
+    s.seq = seq;
+    for(int i=0; i<31; i++)
+        s.check[i] = seq * 2654435761u + i;
+}
+
+static bool whole(const sample &s)
+{
+    for(int i=0; i<31; i++)
+        if(s.check[i] != s.seq * 2654435761u + i)
+            return false;
+    return true;
+}
+
+static void test_latest()
+{
+    // one thread alone, the newest of several published is fetched once
+    latest<sample> l;
+    for(uint64_t seq=1; seq<=3; seq++) {
+        fill(l.back(), seq);
+        l.publish();
+    }
+    CHECK(l.fetch() && l.front().seq == 3 && whole(l.front()));
+    CHECK(!l.fetch() && l.front().seq == 3);
+
+    // a writer publishing while the reader fetches, both yielding now and
+    // then so they interleave on a single cpu too.  After published is
+    // read, whatever is fetched is at least that new
+    const uint64_t n = 2000000;
+    latest<sample> m;
+    std::atomic<uint64_t> published(0);
+    std::thread writer([&]() {
+        for(uint64_t seq=1; seq<=n; seq++) {
+            fill(m.back(), seq);
+            m.publish();
+            published.store(seq);
+            if(seq % 8 == 0)
+                std::this_thread::yield();
+        }
+    });
+
+    uint64_t last = 0, fetches = 0;
+    bool torn = false, older = false, stale = false;
+    while(last < n) {
+        uint64_t p = published.load();
+        if(m.fetch()) {
+            // read in two halves with the writer let in between, the
+            // front slot must not be written meanwhile
+            const sample &s = m.front();
+            uint64_t seq = s.seq;
+            std::this_thread::yield();
+            torn = torn || !whole(s) || s.seq != seq;
+            older = older || seq <= last;
+            last = seq;
+            fetches++;
+        } else
+            std::this_thread::yield();
+        stale = stale || m.front().seq < p;
+    }
+    writer.join();
+    CHECK(!torn && !older && !stale);
+    CHECK(!m.fetch() && m.front().seq == n);
+    printf("latest: %llu values published, %llu fetched\n",
+           (unsigned long long)n, (unsigned long long)fetches);
+}
+
+static time_point at(double seconds)
+{
+    return time_point() + std::chrono::hours(1) + std::chrono::duration_cast<time_point::duration>(
+        std::chrono::duration<double>(seconds));
+}
+
+// the course from a fix at sog turning at rot, stepped along great circles
+static void stepped(double lat, double lon, double sog, double cog, double rot, double dt,
+                    double &slat, double &slon, double &scog)
+{
+    const int steps = 1000;
+    double h = dt / steps;
+    for(int i=0; i<steps; i++) {
+        // each step along the course at its middle
+        double c = cog + rot * (i + .5) * h;
+        ll_gc_ll(lat, lon, c, sog * h / 3600, &lat, &lon);
+    }
+    slat = lat, slon = lon, scog = fmod(cog + rot * dt + 360, 360);
+}
+
+// meters between two positions
+static double meters(double lat0, double lon0, double lat1, double lon1)
+{
+    double brg, dist;
+    APR_ll_gc_ll_reverse(lat0, lon0, lat1, lon1, &brg, &dist);
+    return dist * 1852;
+}
+
+// turn rate the prediction at dt uses, from the course it predicts
+static double predicted_rot(dead_reckoning &dr, double cog, double t, double dt)
+{
+    double lat, lon, c = cog;
+    dr.predict(at(t + dt), lat, lon, c);
+    return remainder(c - cog, 360) / dt;
+}
+
+static void test_dead_reckoning()
+{
+    dead_reckoning dr;
+    double lat, lon, cog;
+    CHECK(dr.predict(at(0), lat, lon, cog) == -1);
+
+    // straight, along the course at the speed
+    dr.fix(50, -4, 12, 60, at(0));
+    CHECK(dr.predict(at(2), lat, lon, cog) == 2 && cog == 60);
+    double slat, slon, scog;
+    stepped(50, -4, 12, 60, 0, 2, slat, slon, scog);
+    CHECK(meters(lat, lon, slat, slon) < .05);
+    dr.fix(slat, slon, 12, 60, at(2));
+    CHECK(predicted_rot(dr, 60, 2, 1) == 0);
+
+    // at the fix itself, or too old to extrapolate
+    CHECK(dr.predict(at(2), lat, lon, cog) == 0 && lat == slat && lon == slon);
+    CHECK(dr.predict(at(2 + dead_reckoning::max_age + .1), lat, lon, cog) == 0 &&
+          lat == slat && lon == slon && cog == 60);
+    CHECK(fabs(dr.predict(at(2 + dead_reckoning::max_age - .1), lat, lon, cog) -
+               (dead_reckoning::max_age - .1)) < 1e-6);
+
+    // turning at 6 degrees per second, the rate filtered over the fixes
+    double t = 2, c = 60, rot = 0;
+    wp p(slat, slon);
+    for(int i=0; i<10; i++) {
+        stepped(p.lat, p.lon, 12, c, 6, 1, p.lat, p.lon, c);
+        dr.fix(p.lat, p.lon, 12, c, at(++t));
+        rot = rot*.5 + 6*.5;
+        CHECK(fabs(predicted_rot(dr, c, t, .5) - rot) < 1e-6);
+    }
+    double dt = 1.5;
+    dr.predict(at(t + dt), lat, lon, cog);
+    stepped(p.lat, p.lon, 12, c, rot, dt, slat, slon, scog);
+    CHECK(meters(lat, lon, slat, slon) < .05 && fabs(remainder(cog - scog, 360)) < 1e-6);
+
+    // fixes further apart than max_age start the rate again
+    stepped(p.lat, p.lon, 12, c, 6, 4, p.lat, p.lon, c);
+    t += dead_reckoning::max_age + 1;
+    dr.fix(p.lat, p.lon, 12, c, at(t));
+    CHECK(predicted_rot(dr, c, t, 1) == 0);
+
+    // a course change faster than max_rot is taken for noise, just under
+    // it is a turn
+    dr.fix(p.lat, p.lon, 12, c + dead_reckoning::max_rot + 1, at(t + 1));
+    CHECK(predicted_rot(dr, c + dead_reckoning::max_rot + 1, t + 1, 1) == 0);
+    c += dead_reckoning::max_rot + 1;
+    dr.fix(p.lat, p.lon, 12, c + dead_reckoning::max_rot - 1, at(t + 2));
+    CHECK(fabs(predicted_rot(dr, c + dead_reckoning::max_rot - 1, t + 2, 1) -
+               (dead_reckoning::max_rot - 1) / 2) < 1e-6);
+
+    // too slow for the course to mean anything
+    dr.fix(p.lat, p.lon, .5, c, at(t + 3));
+    dr.fix(p.lat, p.lon, .5, c + 10, at(t + 4));
+    CHECK(predicted_rot(dr, c + 10, t + 4, 1) == 0);
+}
+
+// sentences sent over seconds of navigation updates at update_rate, each
+// update late by up to jitter, as SendNMEA schedules them
+static int sends(sentence_schedule &s, double rate, double update_rate, double seconds,
+                 double jitter, double &min_interval, double &max_interval)
+{
+    double slack = .5/update_rate, last = -1;
+    nav_solution n;
+    int count = 0;
+    min_interval = INFINITY, max_interval = 0;
+    for(int i=0; i<seconds*update_rate; i++) {
+        double t = i/update_rate + uniform(0, jitter);
+        if(!s.due(at(t), rate, slack, n, false, 1, .01))
+            continue;
+        s.sent(at(t), n);
+        if(last >= 0) {
+            min_interval = std::min(min_interval, t - last);
+            max_interval = std::max(max_interval, t - last);
+        }
+        last = t;
+        count++;
+    }
+    return count;
+}
+
+static void test_schedule()
+{
+    // each sentence at its own rate over a minute of updates at 5 Hz
+    // arriving up to 40 ms late, rate 0 at every update.  2 Hz falls
+    // between updates, so goes every 2 or 3 but never faster than 2 Hz
+    static const struct { double rate; int min, max; } rates[] = {
+        {0, 300, 300}, {2.5, 150, 150}, {2, 100, 120}, {1, 60, 60}, {.5, 30, 30}, {.2, 12, 12}};
+    double lo, hi;
+    for(unsigned int i=0; i<sizeof rates / sizeof *rates; i++) {
+        sentence_schedule s;
+        int count = sends(s, rates[i].rate, 5, 60, .04, lo, hi);
+        CHECK(count >= rates[i].min && count <= rates[i].max);
+        // never an update early or late however the updates fall
+        double period = rates[i].rate ? 1/rates[i].rate : .2;
+        CHECK(lo > period - .2 - .04 && hi < period + .2 + .04);
+    }
+
+    // the first is due at once, and again after reset
+    sentence_schedule s;
+    nav_solution n;
+    n.bearing = 359.6, n.xte = .1;
+    CHECK(s.due(at(0), 1, .1, n, false, 1, .01));
+    s.sent(at(0), n);
+    CHECK(!s.due(at(.2), 1, .1, n, false, 1, .01));
+    s.reset();
+    CHECK(s.due(at(.2), 1, .1, n, false, 1, .01));
+    s.sent(at(.2), n);
+
+    // sent sooner on change: the bearing across north, the cross track
+    // error, and arriving, each from what was last sent
+    nav_solution m = n;
+    m.bearing = .3;
+    CHECK(!s.due(at(.4), 1, .1, m, true, 1, .01));
+    m.bearing = .7;
+    CHECK(s.due(at(.4), 1, .1, m, true, 1, .01));
+    CHECK(!s.due(at(.4), 1, .1, m, false, 1, .01)); // unless only at the rate
+    m = n;
+    m.xte = .105;
+    CHECK(!s.due(at(.4), 1, .1, m, true, 1, .01));
+    m.xte = .089;
+    CHECK(s.due(at(.4), 1, .1, m, true, 1, .01));
+    m = n;
+    m.arrival = true;
+    CHECK(s.due(at(.4), 1, .1, m, true, 1, .01));
+
+    // a slow drift is sent once it adds up to the threshold
+    m = n;
+    int updates = 0;
+    for(int i=1; i<5 && !updates; i++) {
+        m.bearing = fmod(m.bearing + .3, 360);
+        if(s.due(at(.2 + i*.1), 1, .1, m, true, 1, .01))
+            updates = i;
+    }
+    CHECK(updates == 4);
+}
+
+int main()
+{
+    test_latest();
+    test_dead_reckoning();
+    test_schedule();
+    return test_result("navigation");
+}
@@ -0,0 +1,210 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+// nmea_output writing to a udp listener over ipv4 and ipv6, to a client
+// of its tcp server and to a serial port opened on a pseudo terminal
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <wx/init.h>
+
+#include "nmea_output.h"
+#include "test.h"
+
+// distinct sentences, so a lost or reordered one shows
+static std::string sentence(int i)
+{
+    nmea_sentence s("EC", "XTE");
+    s.status(true);
+    s.status(true);
+    s.field(i / 1000., 3);
+    s.field('L');
+    s.field('N');
+    return s.finish();
+}
+
+// a socket bound to a free port on the loopback address of family
+static int listener(int family, int type, int &port)
+{
+    int fd = socket(family, type, 0);
+    if(fd < 0)
+        return -1;
+    struct sockaddr_storage a;
+    socklen_t len;
+    memset(&a, 0, sizeof a);
+    if(family == AF_INET6) {
+        struct sockaddr_in6 *a6 = (struct sockaddr_in6*)&a;
+        a6->sin6_family = AF_INET6;
+        a6->sin6_addr = in6addr_loopback;
+        len = sizeof *a6;
+    } else {
+        struct sockaddr_in *a4 = (struct sockaddr_in*)&a;
+        a4->sin_family = AF_INET;
+        a4->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        len = sizeof *a4;
+    }
+    if(bind(fd, (struct sockaddr*)&a, len) < 0 || getsockname(fd, (struct sockaddr*)&a, &len) < 0) {
+        close(fd);
+        return -1;
+    }
+    port = ntohs(family == AF_INET6 ? ((struct sockaddr_in6*)&a)->sin6_port
+                 : ((struct sockaddr_in*)&a)->sin_port);
+    return fd;
+}
+
+// what arrives on fd until len bytes or a second without any
+static std::string receive(int fd, size_t len)
+{
+    std::string data;
+    char buf[4096];
+    struct pollfd p = {fd, POLLIN, 0};
+    while(data.size() < len && poll(&p, 1, 1000) > 0) {
+        ssize_t n = read(fd, buf, sizeof buf);
+        if(n <= 0)
+            break;
+        data.append(buf, n);
+    }
+    return data;
+}
+
+static void udp(int family, const char *host)
+{
+    int port, fd = listener(family, SOCK_DGRAM, port);
+    if(fd < 0) {
+        printf("udp %s: no loopback address, skipped\n", host);
+        return;
+    }
+
+    nmea_output output(nmea_output::UDP, wxString::Format("%s:%d", host, port));
+    CHECK(output.Open());
+    CHECK(output.Run() == wxTHREAD_NO_ERROR);
+    std::string sent;
+    for(int i=0; i<10; i++) {
+        output.Write(sentence(i).c_str());
+        sent += sentence(i);
+    }
+
+    // a datagram each, read one at a time so they are not merged
+    std::string received;
+    struct pollfd p = {fd, POLLIN, 0};
+    char buf[256];
+    for(int i=0; i<10 && poll(&p, 1, 1000) > 0; i++) {
+        ssize_t n = recv(fd, buf, sizeof buf, 0);
+        CHECK(n == (ssize_t)sentence(i).size());
+        if(n > 0)
+            received.append(buf, n);
+    }
+    output.Stop();
+    CHECK(received == sent);
+    CHECK(output.Dropped() == 0);
+    close(fd);
+}
+
+static void tcp()
+{
+    // a free port for the server
+    int port, fd = listener(AF_INET, SOCK_STREAM, port);
+    CHECK(fd >= 0);
+    close(fd);
+
+    nmea_output output(nmea_output::TCP, wxString::Format("127.0.0.1:%d", port));
+    CHECK(output.Open());
+    CHECK(output.Run() == wxTHREAD_NO_ERROR);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof a);
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(connect(client, (struct sockaddr*)&a, sizeof a) == 0);
+    usleep(500000); // accepted while idle
+
+    std::string sent;
+    for(int i=0; i<10; i++) {
+        output.Write(sentence(i).c_str());
+        sent += sentence(i);
+    }
+    CHECK(receive(client, sent.size()) == sent);
+
+    // a client that went away is dropped without a signal
+    close(client);
+    for(int i=0; i<10; i++) {
+        output.Write(sentence(i).c_str());
+        usleep(10000);
+    }
+    output.Stop();
+}
+
+static void serial()
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    CHECK(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+    wxString device = ptsname(master);
+
+    // the queue is full before the thread runs, so the oldest are dropped
+    // and the newest written in order
+    nmea_output output(nmea_output::SERIAL, device + ":38400");
+    CHECK(output.Open());
+    const int n = nmea_output::queue_size + 10;
+    std::string sent;
+    for(int i=0; i<n; i++) {
+        output.Write(sentence(i).c_str());
+        if(i >= n - nmea_output::queue_size)
+            sent += sentence(i);
+    }
+    CHECK(output.Dropped() == n - nmea_output::queue_size);
+    CHECK(output.Run() == wxTHREAD_NO_ERROR);
+    CHECK(receive(master, sent.size()) == sent);
+    output.Stop();
+    close(master);
+
+    nmea_output missing(nmea_output::SERIAL, "/nonexistent/tty");
+    CHECK(!missing.Open() && !missing.Error().IsEmpty());
+    nmea_output baud(nmea_output::SERIAL, device + ":1234");
+    CHECK(!baud.Open() && !baud.Error().IsEmpty());
+}
+
+int main()
+{
+    wxInitializer initializer;
+    CHECK(initializer.IsOk());
+
+    udp(AF_INET, "127.0.0.1");
+    udp(AF_INET6, "[::1]");
+    tcp();
+    serial();
+
+    return test_result("nmea_output");
+}
@@ -0,0 +1,339 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+// the nmea sentences the plugin sends: the checksum, the field layout of
+// RMB, RMC, APB and XTE, the number formatting and the utc fields, and the
+// sentences formatted per second without allocating, against formatting
+// them as before with the nmea0183 library
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "nmea_sentence.h"
+#include "navigation.h"
+#include "test.h"
+
+// counted to check formatting a sentence allocates nothing
+static long allocations;
+
+void *operator new(size_t n)
+{
+    allocations++;
+    void *p = malloc(n ? n : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// the fields between the address and the checksum, false if the framing
+// or the checksum is wrong
+static bool fields(const char *sentence, const char *address, std::vector<std::string> &f)
+{
+    std::string s(sentence);
+    size_t star = s.find('*');
+    if(s.size() > nmea_sentence::max_length || s[0] != '$' || star == std::string::npos ||
+       s.size() != star + 5 || s.compare(star + 3, 2, "\r\n"))
+        return false;
+
+    unsigned char checksum = 0;
+    for(size_t i=1; i<star; i++)
+        checksum ^= s[i];
+    char hex[3];
+    snprintf(hex, sizeof hex, "%02X", checksum);
+    if(s.compare(star + 1, 2, hex))
+        return false;
+
+    f.clear();
+    size_t p = 1;
+    for(;;) {
+        size_t c = s.find(',', p);
+        if(c == std::string::npos || c > star) {
+            f.push_back(s.substr(p, star - p));
+            break;
+        }
+        f.push_back(s.substr(p, c - p));
+        p = c + 1;
+    }
+    if(f[0] != address)
+        return false;
+    f.erase(f.begin());
+    return true;
+}
+
+static std::string format(double v, int decimals)
+{
+    nmea_sentence s("EC", "XXX");
+    s.field(v, decimals);
+    std::vector<std::string> f;
+    const char *r = s.finish();
+    return r && fields(r, "ECXXX", f) && f.size() == 1 ? f[0] : "?";
+}
+
+static std::string position(double lat, double lon)
+{
+    nmea_sentence s("EC", "XXX");
+    s.latitude(lat);
+    s.longitude(lon);
+    std::vector<std::string> f;
+    const char *r = s.finish();
+    return r && fields(r, "ECXXX", f) && f.size() == 4 ?
+        f[0] + "," + f[1] + "," + f[2] + "," + f[3] : "?";
+}
+
+// a navigation state to send
+static nav_solution solution()
+{
+    nav_solution n;
+    n.xte = -0.01234;
+    n.rng = 3.2567;
+    n.wp_bearing = 123.456;
+    n.leg_bearing = 120.04;
+    n.bearing = 355.25;
+    n.arrival = false;
+    return n;
+}
+static const double lat = -33.8567891, lon = 151.2153, sog = 6.52, cog = 120.3, var = -12.4;
+static const wxString last_wp("Buoy 7");
+static const waypoint current_wp(-33.8567891, 151.2153, "Harbour entrance", "guid", .1, 120.04);
+
+// the sentences of one update as the nmea0183 library formatted them
+// before nmea_sentence: a wxString built field by field with printf
+// formats, copying the names to truncate them
+struct nmea0183_sentence
+{
+    wxString sentence;
+    nmea0183_sentence(const char *address) : sentence(wxString("$") + address) {}
+    void field(const wxString &f) { sentence += ","; sentence += f; }
+    void field(double v) { field(wxString::Format("%.3f", v)); }
+    void position(double v, bool latitude) {
+        double a = fabs(v);
+        int d = (int)a;
+        field(wxString::Format(latitude ? "%02d%07.4f" : "%03d%07.4f", d, (a - d)*60));
+        field(latitude ? (v < 0 ? "S" : "N") : (v < 0 ? "W" : "E"));
+    }
+    wxString finish() {
+        unsigned char checksum = 0;
+        for(size_t i=1; i<sentence.size(); i++)
+            checksum ^= (unsigned char)sentence[i];
+        return sentence + wxString::Format("*%02X\r\n", checksum);
+    }
+};
+
+static size_t nmea0183_update(const nav_solution &n, time_t t)
+{
+    size_t length = 0;
+    wxString origin = last_wp, destination = current_wp.name;
+    origin = origin.substr(0, 6);
+    destination = destination.substr(0, 6);
+    {
+        nmea0183_sentence s("ECRMB");
+        s.field("A"); s.field(n.xte); s.field(n.xte < 0 ? "L" : "R");
+        s.field(origin); s.field(destination);
+        s.position(current_wp.lat, true); s.position(current_wp.lon, false);
+        s.field(n.rng); s.field(n.wp_bearing); s.field(sog); s.field(n.arrival ? "A" : "V");
+        length += s.finish().size();
+    }
+    {
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        nmea0183_sentence s("ECRMC");
+        s.field(wxString::Format("%02d%02d%02d", tm.tm_hour, tm.tm_min, tm.tm_sec)); s.field("A");
+        s.position(lat, true); s.position(lon, false); s.field(sog); s.field(cog);
+        s.field(wxString::Format("%02d%02d%02d", tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100));
+        s.field(fabs(var)); s.field(var < 0 ? "W" : "E");
+        length += s.finish().size();
+    }
+    {
+        nmea0183_sentence s("ECAPB");
+        s.field("A"); s.field("A"); s.field(fabs(n.xte)); s.field(n.xte < 0 ? "L" : "R");
+        s.field("N"); s.field(n.arrival ? "A" : "V"); s.field("V");
+        s.field(n.leg_bearing); s.field("T"); s.field(destination);
+        s.field(n.wp_bearing); s.field("T"); s.field(n.bearing); s.field("T");
+        length += s.finish().size();
+    }
+    {
+        nmea0183_sentence s("ECXTE");
+        s.field("A"); s.field("A"); s.field(fabs(n.xte)); s.field(n.xte < 0 ? "L" : "R");
+        s.field("N");
+        length += s.finish().size();
+    }
+    return length;
+}
+
+// the same update as the plugin sends it now
+static size_t nmea_update(const nav_solution &n, utc_fields &utc, time_t t)
+{
+    nmea_sentence rmb = nmea_rmb(n, last_wp, current_wp, sog);
+    nmea_sentence rmc = nmea_rmc(utc, t, lat, lon, sog, cog, var);
+    nmea_sentence apb = nmea_apb(n, current_wp.name, NAN);
+    nmea_sentence xte = nmea_xte(n);
+    return strlen(rmb.finish()) + strlen(rmc.finish()) +
+        strlen(apb.finish()) + strlen(xte.finish());
+}
+
+int main()
+{
+    std::vector<std::string> f;
+    nav_solution n = solution();
+
+    // the layout of each sentence
+    {
+        nmea_sentence s = nmea_rmb(n, last_wp, current_wp, sog);
+        CHECK(fields(s.finish(), "ECRMB", f) && f.size() == 13);
+        CHECK(f[0] == "A" && f[1] == "0.012" && f[2] == "L" && f[3] == "Buoy 7" &&
+              f[4] == "Harbou" && f[5] == "3351.4073" && f[6] == "S" &&
+              f[7] == "15112.9180" && f[8] == "E" && f[9] == "3.257" &&
+              f[10] == "123.5" && f[11] == "6.52" && f[12] == "V");
+    }
+    {
+        utc_fields utc;
+        nmea_sentence s = nmea_rmc(utc, 1760704496, lat, lon, sog, cog, var);
+        CHECK(fields(s.finish(), "ECRMC", f) && f.size() == 11);
+        CHECK(f[0] == "123456" && f[1] == "A" && f[2] == "3351.4073" && f[3] == "S" &&
+              f[4] == "15112.9180" && f[5] == "E" && f[6] == "6.52" && f[7] == "120.3" &&
+              f[8] == "171025" && f[9] == "12.4" && f[10] == "W");
+
+        // an unknown variation is left empty
+        s = nmea_rmc(utc, 1760704496, lat, lon, sog, cog, NAN);
+        CHECK(fields(s.finish(), "ECRMC", f) && f.size() == 11 && f[9] == "" && f[10] == "");
+    }
+    {
+        nmea_sentence s = nmea_apb(n, current_wp.name, NAN);
+        CHECK(fields(s.finish(), "ECAPB", f) && f.size() == 14);
+        CHECK(f[0] == "A" && f[1] == "A" && f[2] == "0.012" && f[3] == "L" && f[4] == "N" &&
+              f[5] == "V" && f[6] == "V" && f[7] == "120.0" && f[8] == "T" &&
+              f[9] == "Harbou" && f[10] == "123.5" && f[11] == "T" &&
+              f[12] == "355.3" && f[13] == "T");
+
+        // magnetic, wrapped through north
+        s = nmea_apb(n, current_wp.name, 10);
+        CHECK(fields(s.finish(), "ECAPB", f) && f.size() == 14);
+        CHECK(f[7] == "130.0" && f[8] == "M" && f[10] == "133.5" && f[11] == "M" &&
+              f[12] == "5.3" && f[13] == "M");
+    }
+    {
+        nmea_sentence s = nmea_xte(n);
+        const char *r = s.finish();
+        CHECK(r && !strcmp(r, "$ECXTE,A,A,0.012,L,N*4C\r\n"));
+        CHECK(fields(r, "ECXTE", f) && f.size() == 5);
+
+        // steering right, inside the arrival circle
+        n.xte = .5;
+        n.arrival = true;
+        s = nmea_rmb(n, last_wp, current_wp, sog);
+        CHECK(fields(s.finish(), "ECRMB", f) && f[1] == "0.500" && f[2] == "R" && f[12] == "A");
+        n = solution();
+    }
+
+    // numbers are rounded, not truncated, and never printed as -0
+    CHECK(format(0, 0) == "0");
+    CHECK(format(1.25, 1) == "1.3");
+    CHECK(format(9.9996, 3) == "10.000");
+    CHECK(format(-2.5, 2) == "-2.50");
+    CHECK(format(-0.0001, 2) == "0.00");
+    CHECK(format(123456.654321, 6) == "123456.654321");
+    CHECK(format(NAN, 1) == "");
+    CHECK(format(1e12, 1) == "");
+
+    // minutes rounded into the degrees they carry into
+    CHECK(position(0, 0) == "0000.0000,N,00000.0000,E");
+    CHECK(position(59.9999999, -0.5) == "6000.0000,N,00030.0000,W");
+    CHECK(position(-89.99999999, 179.99999999) == "9000.0000,S,18000.0000,E");
+    CHECK(position(NAN, NAN) == ",,,");
+
+    // names are cut to their field and cannot break the framing
+    {
+        nmea_sentence s("EC", "XXX");
+        s.field(wxString("a,b*c$d!e\\f\tg~"), 20);
+        s.field(wxString("Harbour entrance"), 6);
+        CHECK(fields(s.finish(), "ECXXX", f) && f.size() == 2);
+        CHECK(f[0] == "a_b_c_d_e_f_g~" && f[1] == "Harbou");
+    }
+
+    // the longest sentence allowed fits, one more character does not
+    for(int extra=0; extra<2; extra++) {
+        nmea_sentence s("EC", "XXX");
+        // $ECXXX, the comma, the field and *hh\r\n
+        s.field(std::string(nmea_sentence::max_length - 12 + extra, 'x').c_str());
+        const char *r = s.finish();
+        if(extra)
+            CHECK(!r);
+        else
+            CHECK(r && strlen(r) == nmea_sentence::max_length && fields(r, "ECXXX", f));
+    }
+
+    // the utc fields against gmtime, over days, leap years and the epoch
+    {
+        utc_fields utc;
+        std::vector<time_t> times = {0, 59, 86399, 86400, 951782400, 951868799, 4107542400LL - 1,
+                                     4107542400LL, 1760704496, -1, -86400, -86401};
+        for(int i=0; i<100000; i++)
+            times.push_back((time_t)uniform(-2208988800., 4102444800.));
+        for(unsigned int i=0; i<times.size(); i++) {
+            time_t t = times[i];
+            struct tm tm;
+            gmtime_r(&t, &tm);
+            char hhmmss[40], ddmmyy[40];
+            snprintf(hhmmss, sizeof hhmmss, "%02d%02d%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+            snprintf(ddmmyy, sizeof ddmmyy, "%02d%02d%02d", tm.tm_mday, tm.tm_mon + 1,
+                     (tm.tm_year + 1900) % 100);
+            utc.set(t);
+            if(strcmp(utc.time(), hhmmss) || strcmp(utc.date(), ddmmyy)) {
+                fprintf(stderr, "utc %lld: %s %s, gmtime %s %s\n", (long long)t,
+                        utc.time(), utc.date(), hhmmss, ddmmyy);
+                CHECK(false);
+                break;
+            }
+        }
+    }
+
+    // the four sentences of an update, as often as they can be formatted,
+    // against formatting them as the nmea0183 library did
+    {
+        const int runs = 100000;
+        utc_fields utc;
+        size_t length = 0;
+        allocations = 0;
+        double ns = time_ns(runs, [&](int i) { length += nmea_update(n, utc, 1760704496 + i); });
+        long count = allocations;
+        allocations = 0;
+        double before_ns = time_ns(runs, [&](int i) { length += nmea0183_update(n, 1760704496 + i); });
+        test_sink = length;
+        printf("nmea0183:      %8.0f sentences/s, %5.2f allocations per sentence\n",
+               4e9 / before_ns, (double)allocations / (4 * runs));
+        printf("nmea_sentence: %8.0f sentences/s, %5.2f allocations per sentence\n",
+               4e9 / ns, (double)count / (4 * runs));
+        CHECK(count == 0);
+    }
+
+    return test_result("nmea_sentence");
+}
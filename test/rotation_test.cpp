@@ -0,0 +1,217 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+// rotate and the circle and bearing intersections against the quaternion
+// rotations they replaced, and the time of each before and after
+
+#include <math.h>
+#include <algorithm>
+
+#include "computation.h"
+#include "test.h"
+
+using namespace computation_gc;
+
+static const double earth_radius = 6378137.0; // meters
+
+// the rotation as it was computed before, by two hamilton products
+struct quaternion
+{
+    quaternion(double angle, vector &v) {
+        double n = v.norm(), s = sin(angle/2), c = cos(angle/2);
+        double fac = n == 0 ? 0 : s / n;
+        r = c, i = v.x*fac, j = v.y*fac, k = v.z*fac;
+    }
+    quaternion operator*(const quaternion &q) {
+        return quaternion(r*q.r - i*q.i - j*q.j - k*q.k,
+                          r*q.i + i*q.r + j*q.k - k*q.j,
+                          r*q.j - i*q.k + j*q.r + k*q.i,
+                          r*q.k + i*q.j - j*q.i + k*q.r);
+    }
+    quaternion conjugate() { return quaternion(r, -i, -j, -k); }
+    vector rotate(vector &v) {
+        quaternion w(0, v.x, v.y, v.z);
+        quaternion q = *this*w*conjugate();
+        return vector(q.i, q.j, q.k);
+    }
+
+private:
+    quaternion(double _r, double _i, double _j, double _k) : r(_r), i(_i), j(_j), k(_k) {}
+    double r, i, j, k;
+};
+
+static bool intersect_circle_before(wp &p, double dist, segment &s, wp &w)
+{
+    vector c = ll2v(p), m = cross(s.n, c);
+    m.normalize();
+    vector v = cross(m, s.n);
+
+    double a = dot(c, v), d = cos(dist / earth_radius);
+    if(a < d)
+        return false;
+
+    quaternion q(acos(d/a), s.n);
+    vector w0 = q.rotate(v), w1 = q.conjugate().rotate(v);
+    d = s.d;
+    bool bp0 = dot(w0, s.v0) > d && dot(w0, s.v1) > d;
+    bool bp1 = dot(w1, s.v0) > d && dot(w1, s.v1) > d;
+    if(bp0 && (!bp1 || dot(w0, s.v1) > dot(w1, s.v1))) {
+        w = v2ll(w0);
+        return true;
+    } else if(bp1) {
+        w = v2ll(w1);
+        return true;
+    }
+    return false;
+}
+
+static bool intersect_before(wp &p, double brg, segment &s, wp &w)
+{
+    vector north(0, 0, 1), c = ll2v(p);
+    quaternion q(brg, c);
+    vector b = q.rotate(north), m = cross(c, b);
+    m.normalize();
+    vector i = cross(s.n, m);
+    w = v2ll(i);
+    return dot(i, s.v0) > s.d && dot(i, s.v1) > s.d;
+}
+
+static vector random_unit()
+{
+    vector v(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+    v.normalize();
+    return v;
+}
+
+static wp random_near(wp &p, double degrees)
+{
+    return wp(std::min(std::max(p.lat + uniform(-degrees, degrees), -89.9), 89.9),
+              p.lon + uniform(-degrees, degrees));
+}
+
+static double error(wp &a, wp &b)
+{
+    vector u = ll2v(a), v = ll2v(b), d(u.x - v.x, u.y - v.y, u.z - v.z);
+    return d.norm() * earth_radius;
+}
+
+struct intersect_case
+{
+    wp p, p0, p1;
+    segment s;
+    double dist, brg;
+};
+
+int main()
+{
+    const int n = 100000;
+
+    double max_rotate = 0;
+    for(int i=0; i<n; i++) {
+        vector v = random_unit(), k = random_unit();
+        double angle = uniform(-M_PI, M_PI);
+        vector r = rotate(v, k, sin(angle), cos(angle)), q = quaternion(angle, k).rotate(v);
+        max_rotate = std::max(max_rotate, fabs(r.x - q.x) + fabs(r.y - q.y) + fabs(r.z - q.z));
+    }
+
+    std::vector<intersect_case> cases(n);
+    for(int i=0; i<n; i++) {
+        intersect_case &c = cases[i];
+        c.p = wp(asin(uniform(-1, 1)) * 180 / M_PI, uniform(-180, 180));
+        c.p0 = random_near(c.p, .2);
+        c.p1 = random_near(c.p, .2);
+        vector v0 = ll2v(c.p0), v1 = ll2v(c.p1);
+        c.s = segment(v0, v1);
+        // circles crossing the great circle well away from grazing it, where
+        // acos(d/a) of the quaternion version lost precision
+        vector pv = ll2v(c.p);
+        double x = fabs(asin(dot(c.s.n, pv))) * earth_radius;
+        c.dist = std::max(x / uniform(.1, .9), 1000.0);
+
+        c.brg = uniform(-M_PI, M_PI);
+    }
+
+    int circle_hits = 0, circle_differ = 0, hits = 0, differ = 0;
+    double max_circle = 0, max_intersect = 0;
+    for(int i=0; i<n; i++) {
+        intersect_case &c = cases[i];
+        wp w, wb;
+        bool hit = intersect_circle(c.p, c.dist, c.s, w);
+        if(hit != intersect_circle_before(c.p, c.dist, c.s, wb))
+            circle_differ++;
+        else if(hit) {
+            circle_hits++;
+            max_circle = std::max(max_circle, error(w, wb));
+        }
+
+        // w is set by both whether or not it falls on the segment
+        hit = intersect(c.p, c.brg, c.s, w);
+        if(hit != intersect_before(c.p, c.brg, c.s, wb))
+            differ++;
+        hits += hit;
+        max_intersect = std::max(max_intersect, error(w, wb));
+    }
+
+    printf("largest difference from the quaternion rotations over %d cases:\n", n);
+    printf("  rotate %g\n", max_rotate);
+    printf("  intersect_circle %g m (%d hits, %d differ)\n", max_circle, circle_hits, circle_differ);
+    printf("  intersect %g m (%d hits, %d differ)\n", max_intersect, hits, differ);
+
+    CHECK(max_rotate < 1e-14);
+    CHECK(max_circle < 1e-4); // the precision of the quaternion version at 1 km
+    CHECK(max_intersect < 1e-4);
+    CHECK(circle_hits > n/10);
+    CHECK(circle_differ < n/10000 + 1 && differ < n/10000 + 1);
+
+    const int m = 1000000, mask = 1023;
+    std::vector<vector> vs(mask + 1);
+    for(unsigned int i=0; i<vs.size(); i++)
+        vs[i] = random_unit();
+    double before = time_ns(m, [&](int i) {
+            test_sink = quaternion(i * 1e-6, vs[i&mask]).rotate(vs[(i+1)&mask]).x; });
+    double after = time_ns(m, [&](int i) {
+            test_sink = rotate(vs[(i+1)&mask], vs[i&mask], sin(i * 1e-6), cos(i * 1e-6)).x; });
+    printf("rotate            before %6.1f ns  after %6.1f ns\n", before, after);
+
+    wp w;
+    before = time_ns(m, [&](int i) {
+            intersect_case &c = cases[i % n];
+            test_sink = intersect_circle_before(c.p, c.dist, c.s, w); });
+    after = time_ns(m, [&](int i) {
+            intersect_case &c = cases[i % n];
+            test_sink = intersect_circle(c.p, c.dist, c.s, w); });
+    printf("intersect_circle  before %6.1f ns  after %6.1f ns\n", before, after);
+
+    before = time_ns(m, [&](int i) {
+            intersect_case &c = cases[i % n];
+            test_sink = intersect_before(c.p, c.brg, c.s, w); });
+    after = time_ns(m, [&](int i) {
+            intersect_case &c = cases[i % n];
+            test_sink = intersect(c.p, c.brg, c.s, w); });
+    printf("intersect         before %6.1f ns  after %6.1f ns\n", before, after);
+
+    return test_result("rotation");
+}
@@ -0,0 +1,266 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+// the route refresh with the messages opencpn sends when the active route
+// is edited: a burst of OCPN_RTE_MODIFIED and OCPN_WPT_MODIFIED is
+// requested once, and the OCPN_ROUTE_RESPONSE that follows is applied by
+// route_receiver to the compiled route in place.  Each update must leave
+// the route as compiling it from scratch would.
+
+#include <math.h>
+
+#include "georef.h"
+#include "route_receiver.h"
+#include "test.h"
+
+static const char *const active = "active-route";
+static const route_geometry geometry = { APR_ll_gc_ll_reverse, ll_gc_ll };
+
+// the response opencpn sends for the waypoints, spaced changes the
+// message but not the route
+static std::string response(const std::vector<waypoint> &waypoints, const char *guid = active,
+                            bool spaced = false)
+{
+    std::string json = std::string("{\"GUID\":\"") + guid + "\",\"waypoints\":[";
+    char buf[256];
+    for(unsigned int i=0; i<waypoints.size(); i++) {
+        const waypoint &w = waypoints[i];
+        snprintf(buf, sizeof buf, "%s{\"lat\":%.6f,\"lon\":%.6f,\"Name\":\"%s\","
+                 "\"GUID\":\"%s\",\"ArrivalRadius\":%g}", i ? (spaced ? ", " : ",") : "",
+                 w.lat, w.lon, (const char*)w.name.mb_str(), (const char*)w.GUID.mb_str(),
+                 w.arrival_radius);
+        json += buf;
+    }
+    return json + "]}";
+}
+
+static std::vector<waypoint> route_waypoints(int n)
+{
+    std::vector<waypoint> waypoints;
+    char name[32], guid[32];
+    for(int i=0; i<n; i++) {
+        snprintf(name, sizeof name, "WP %d", i);
+        snprintf(guid, sizeof guid, "wp-%d", i);
+        waypoints.push_back(waypoint(50 + i * .01, -4 - i * .01, name, guid, .05, 0));
+    }
+    return waypoints;
+}
+
+static route_receiver::result receive(route_receiver &receiver, const std::string &json,
+                                      wp boat, const wxString &request = active)
+{
+    route_response r;
+    route_receiver::result result = receiver.parse(json.data(), json.size(), request, r);
+    if(result != route_receiver::RECEIVED)
+        return result;
+    return receiver.apply(r, boat, 0, false);
+}
+
+// the route compiled in place matches the same route compiled from its
+// start, for all the waypoints and segments navigated
+static bool same_as_compiled(ap_route &route)
+{
+    ap_route full = route;
+    segment_index index;
+    route_receiver compiler(full, index);
+    compiler.geometry = geometry;
+    compiler.compile();
+
+    bool same = true;
+    int n = route.size();
+    for(int i = route.start; i < n; i++) {
+        computation_gc::vector &p = route.points[i], &q = full.points[i];
+        computation_gc::vector &a = route.arrival_normal[i], &b = full.arrival_normal[i];
+        same = same && p.x == q.x && p.y == q.y && p.z == q.z &&
+            a.x == b.x && a.y == b.y && a.z == b.z &&
+            route.route_distance[i] == full.route_distance[i] &&
+            route.segment_arrays.px[i] == full.segment_arrays.px[i];
+        if(i == n-1)
+            break;
+        computation_gc::segment &s = route.segments[i], &t = full.segments[i];
+        same = same && s.n.x == t.n.x && s.n.y == t.n.y && s.n.z == t.n.z && s.d == t.d &&
+            route.leg_bearing[i] == full.leg_bearing[i] &&
+            route.leg_distance[i] == full.leg_distance[i] &&
+            route.segment_arrays.nx[i] == full.segment_arrays.nx[i] &&
+            route.segment_arrays.d[i] == full.segment_arrays.d[i];
+    }
+    return same;
+}
+
+static int count(const std::vector<bool> &dirty)
+{
+    int c = 0;
+    for(unsigned int i=0; i<dirty.size(); i++)
+        c += dirty[i];
+    return c;
+}
+
+int main()
+{
+    const int n = 1000;
+    route_refresh refresh;
+    ap_route route;
+    segment_index index;
+    route_receiver receiver(route, index);
+    receiver.geometry = geometry;
+    std::vector<waypoint> waypoints = route_waypoints(n);
+    wp boat(49.99, -3.99);
+
+    // the route as first received
+    wxDateTime now(1700000000);
+    CHECK(refresh.due(now)); // requested until a response arrives
+    CHECK(receive(receiver, response(waypoints), boat) == route_receiver::NEW);
+    refresh.received(now);
+    CHECK(!refresh.due(now));
+    CHECK(route.size() == n && same_as_compiled(route));
+
+    // a response to another request, or not decoded
+    CHECK(receive(receiver, response(waypoints, "other-route"), boat) == route_receiver::IGNORED);
+    CHECK(receive(receiver, "{\"GUID\":", boat) == route_receiver::FAILED);
+
+    // edits of other routes and waypoints are not requested
+    CHECK(!refresh.modified("OCPN_RTE_MODIFIED", "other-route", active, route));
+    CHECK(!refresh.modified("OCPN_WPT_MODIFIED", "other-wp", active, route));
+    CHECK(!refresh.modified("OCPN_RTE_MODIFIED", active, "", route)); // not navigating
+    CHECK(!refresh.due(now));
+
+    // dragging a waypoint sends a burst of both, requested once
+    int requests = 0;
+    for(int tick=0; tick<10; tick++) {
+        if(tick < 5) {
+            CHECK(refresh.modified("OCPN_WPT_MODIFIED", "wp-500", active, route));
+            CHECK(refresh.modified("OCPN_RTE_MODIFIED", active, active, route));
+            continue;
+        }
+        now = now + wxTimeSpan::Seconds(1);
+        requests += refresh.due(now);
+    }
+    CHECK(requests == 1);
+
+    // the response applies in place, only the moved waypoint and the
+    // arrival bearing of the next change
+    waypoints[500].lat += .001;
+    CHECK(receive(receiver, response(waypoints), boat) == route_receiver::UPDATED);
+    refresh.received(now);
+    CHECK(count(receiver.dirty) == 2 && receiver.dirty[500] && receiver.dirty[501]);
+    CHECK(route.lat[500] == waypoints[500].lat && same_as_compiled(route));
+
+    // the same response again is not decoded, and the same route sent
+    // differently changes nothing
+    CHECK(receive(receiver, response(waypoints), boat) == route_receiver::REPEATED);
+    CHECK(receive(receiver, response(waypoints, active, true), boat) == route_receiver::UNCHANGED);
+
+    // edits while navigating: moved waypoints, renamed and with another
+    // arrival radius, each a burst of messages and one request
+    int updates = 0;
+    bool same = true;
+    for(int edit=0; edit<200; edit++) {
+        int moved = 1 + test_random() % 3;
+        for(int m=0; m<moved; m++) {
+            waypoint &w = waypoints[1 + test_random() % (n-1)];
+            switch(test_random() % 4) {
+            case 0: w.name += "'"; break;
+            case 1: w.arrival_radius *= 1.5; break;
+            default: w.lat += uniform(-.005, .005); w.lon += uniform(-.005, .005);
+            }
+            CHECK(refresh.modified("OCPN_WPT_MODIFIED", w.GUID, active, route));
+        }
+        CHECK(refresh.modified("OCPN_RTE_MODIFIED", active, active, route));
+        now = now + wxTimeSpan::Seconds(1);
+        if(!refresh.due(now))
+            continue;
+        updates += receive(receiver, response(waypoints), boat) == route_receiver::UPDATED;
+        refresh.received(now);
+        same = same && same_as_compiled(route);
+    }
+    CHECK(updates == 200 && same);
+
+    // started part way along with the boat intercepting the route, the
+    // start waypoint moved to the intercept as the plugin does
+    const int start = 300;
+    route.start = start;
+    waypoint intercept(route.lat[start] + .002, route.lon[start] - .001, "intersection", "",
+                       route.arrival_radius[start], 45);
+    route.set(start, intercept);
+    receiver.compile_waypoint(start);
+    CHECK(same_as_compiled(route));
+
+    // the waypoint after the intercept compiles the segment from it and
+    // the route distances from the start, so does the last waypoint
+    int after[] = {start + 1, n - 1, start + 2, start + 1};
+    same = true;
+    for(int i : after) {
+        waypoints[i].lon += .003;
+        same = same && receive(receiver, response(waypoints), boat) == route_receiver::UPDATED;
+        same = same && receiver.dirty[i] && !receiver.dirty[start] && same_as_compiled(route);
+        same = same && route.route_distance[start] == 0;
+    }
+    CHECK(same);
+
+    // and the intercept is kept through edits further along
+    for(int edit=0; edit<50; edit++) {
+        waypoints[start + 1 + test_random() % (n - start - 1)].lat += uniform(-.005, .005);
+        same = same && receive(receiver, response(waypoints), boat) == route_receiver::UPDATED;
+        same = same && same_as_compiled(route);
+    }
+    CHECK(same);
+    CHECK(route.start == start && route.lat[start] == intercept.lat &&
+          route.lon[start] == intercept.lon && route.name[start] == "intersection" &&
+          route.arrival_bearing[start] == 45);
+
+    // the start waypoint edited, compiled from scratch without the intercept
+    waypoints[start].lat += .001;
+    CHECK(receive(receiver, response(waypoints), boat) == route_receiver::NEW);
+    CHECK(route.start == 0 && route.name[start] == waypoints[start].name);
+
+    // compiled again from scratch when a waypoint is added
+    waypoints.push_back(waypoint(60, -14, "WP end", "wp-end", .05, 0));
+    CHECK(receive(receiver, response(waypoints), boat) == route_receiver::NEW);
+    CHECK(route.size() == n + 1 && route.start == 0 && same_as_compiled(route));
+
+    // or when activated again
+    receiver.reset();
+    CHECK(receive(receiver, response(waypoints), boat) == route_receiver::NEW);
+
+    // a route of a single waypoint has ended
+    std::vector<waypoint> single(1, waypoints[0]);
+    CHECK(receive(receiver, response(single), boat) == route_receiver::ENDED);
+    CHECK(route.empty());
+    CHECK(receive(receiver, response(waypoints), boat) == route_receiver::NEW);
+
+    // without notifications the route is still polled, once a minute
+    requests = 0;
+    for(int tick=0; tick<120; tick++) {
+        now = now + wxTimeSpan::Seconds(1);
+        if(refresh.due(now)) {
+            requests++;
+            refresh.received(now);
+        }
+    }
+    CHECK(requests == 1);
+
+    return test_result("route_refresh");
+}
@@ -0,0 +1,214 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+// route_response on well formed, malformed and truncated responses, and
+// the time and peak memory to decode a route of 50000 waypoints against
+// the json tree the plugin decoded it with before
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+
+#include "json/json.h"
+
+#include "route_response.h"
+#include "test.h"
+
+// heap use through new, to report the peak of each decoder
+static long long heap_bytes, heap_peak;
+static long heap_allocations;
+
+void *operator new(size_t n)
+{
+    // the size is kept in front of the block for delete
+    void *p = malloc(n + 16);
+    if(!p)
+        throw std::bad_alloc();
+    *(size_t*)p = n;
+    heap_allocations++;
+    heap_bytes += n;
+    if(heap_bytes > heap_peak)
+        heap_peak = heap_bytes;
+    return (char*)p + 16;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept
+{
+    if(!p)
+        return;
+    p = (char*)p - 16;
+    heap_bytes -= *(size_t*)p;
+    free(p);
+}
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+
+// peak heap above what was in use before f, and the allocations it made
+template<class F> void heap_use(F f, double &peak_mb, long &allocations)
+{
+    heap_peak = heap_bytes;
+    long long before = heap_bytes;
+    long count = heap_allocations;
+    f();
+    peak_mb = (heap_peak - before) / 1e6;
+    allocations = heap_allocations - count;
+}
+
+static bool parse(route_response &r, const std::string &json)
+{
+    // an exact copy, so reading past the end is caught by the sanitizers
+    std::vector<char> buf(json.begin(), json.end());
+    return r.parse(buf.data(), buf.size());
+}
+
+// a response as opencpn sends it, with the members not used in between
+static std::string response(int n)
+{
+    std::string json = "{\"GUID\":\"route-guid\",\"error\":false,\"waypoints\":[";
+    char buf[512];
+    for(int i=0; i<n; i++) {
+        snprintf(buf, sizeof buf,
+                 "%s{\"lat\":%.9f,\"lon\":%.9f,\"Name\":\"WP %d\",\"GUID\":\"guid-%d\","
+                 "\"Description\":\"\",\"ArrivalRadius\":0.05,\"IsActive\":false,"
+                 "\"WaypointRangeRings\":{\"visible\":false,\"number\":0,\"step\":1.0,"
+                 "\"units\":0,\"colour\":\"#FF0000\"}}",
+                 i ? "," : "", 50 + i * 1e-4, -4 - i * 1e-4, i, i);
+        json += buf;
+    }
+    return json + "]}";
+}
+
+// the response decoded as the plugin did before route_response, through
+// a json tree and a lookup of each member by name
+static bool parse_tree(const std::string &json, wxString &guid, std::vector<waypoint> &waypoints)
+{
+    Json::Value root;
+    Json::Reader reader;
+    if(!reader.parse(json, root) || root["error"].asBool())
+        return false;
+
+    guid = root["GUID"].asString();
+    Json::Value w = root["waypoints"];
+    waypoints.clear();
+    for(int i=0; i<(int)w.size(); i++)
+        waypoints.push_back(waypoint(w[i]["lat"].asDouble(), w[i]["lon"].asDouble(),
+                                     w[i]["Name"].asString(), w[i]["GUID"].asString(),
+                                     w[i]["ArrivalRadius"].asDouble(), 0));
+    return true;
+}
+
+int main()
+{
+    route_response r;
+
+    // well formed
+    CHECK(parse(r, "{}") && !r.error && r.waypoints.empty());
+    CHECK(parse(r, " {\"error\" : true } ") && r.error);
+    CHECK(parse(r, "{\"GUID\":\"a\\\"b\\\\c\\u00e9\\ud83d\\ude00\",\"waypoints\":[]}"));
+    CHECK(r.GUID == wxString::FromUTF8("a\"b\\c\xc3\xa9\xf0\x9f\x98\x80", 11));
+    CHECK(parse(r, "{\"x\":[1,{\"y\":null},\"]\"],\"waypoints\":[{\"lat\":1.5e1,\"lon\":-2.25,"
+                "\"Name\":null,\"z\":{\"w\":[true]},\"ArrivalRadius\":0.1,\"GUID\":\"g\"}]}"));
+    CHECK(r.waypoints.size() == 1);
+    if(r.waypoints.size() == 1) {
+        CHECK(r.waypoints[0].lat == 15 && r.waypoints[0].lon == -2.25);
+        CHECK(r.waypoints[0].arrival_radius == .1);
+        CHECK(r.waypoints[0].GUID == "g" && r.waypoints[0].name.IsEmpty());
+    }
+
+    // malformed, each must fail without reading past the end
+    static const char *const malformed[] = {
+        "", " ", "[]", "{", "{\"a\"}", "{\"a\":}", "{\"a\" 1}", "{\"a\":1,}", "{\"a\":1 \"b\":2}",
+        "{a:1}", "{\"a\":tru}", "{\"a\":nul}", "{\"a\":1.2.3}", "{\"a\":\"\\x\"}",
+        "{\"a\":\"\\u12\"}", "{\"a\":\"\\ud800\"}", "{\"a\":\"\\ud800\\u0041\"}",
+        "{\"waypoints\":[{\"lat\":abc}]}", "{\"waypoints\":[1]}", "{\"waypoints\":[{},]}",
+        "{\"waypoints\":[{\"lat\":1}", "{\"a\":[1,2}", "{\"a\":{\"b\":1]}"};
+    for(unsigned int i=0; i<sizeof malformed / sizeof *malformed; i++) {
+        bool ok = parse(r, malformed[i]);
+        if(ok)
+            fprintf(stderr, "parsed: %s\n", malformed[i]);
+        CHECK(!ok && r.error_offset >= 0 && r.error_offset <= (int)strlen(malformed[i]));
+    }
+
+    // nested deeper than the parser follows
+    std::string deep = "{\"a\":" + std::string(100, '[') + std::string(100, ']') + "}";
+    CHECK(!parse(r, deep));
+
+    // every truncation of a response fails
+    std::string json = response(3);
+    int truncated = 0;
+    for(size_t len = 0; len < json.size(); len++)
+        truncated += !parse(r, json.substr(0, len));
+    CHECK(truncated == (int)json.size());
+    CHECK(parse(r, json) && r.waypoints.size() == 3);
+
+    // a large route, checked and timed
+    const int n = 50000;
+    json = response(n);
+    CHECK(parse(r, json) && !r.error && r.GUID == "route-guid");
+    CHECK((int)r.waypoints.size() == n);
+    if((int)r.waypoints.size() == n) {
+        waypoint &w = r.waypoints[n-1];
+        CHECK(fabs(w.lat - (50 + (n-1) * 1e-4)) < 1e-9 && fabs(w.lon - (-4 - (n-1) * 1e-4)) < 1e-9);
+        CHECK(w.name == "WP 49999" && w.GUID == "guid-49999" && w.arrival_radius == .05);
+    }
+
+    // the same waypoints as from the json tree
+    wxString guid;
+    std::vector<waypoint> tree;
+    CHECK(parse_tree(json, guid, tree) && guid == r.GUID && tree.size() == r.waypoints.size());
+    int same = 0;
+    for(unsigned int i=0; i<tree.size() && i<r.waypoints.size(); i++) {
+        waypoint &a = tree[i], &b = r.waypoints[i];
+        same += a.lat == b.lat && a.lon == b.lon && a.name == b.name && a.GUID == b.GUID &&
+            a.arrival_radius == b.arrival_radius;
+    }
+    CHECK(same == n);
+
+    const int runs = 10;
+    double ns = time_ns(runs, [&](int) { test_sink = r.parse(json.data(), json.size()); });
+    double tree_ns = time_ns(runs, [&](int) { test_sink = parse_tree(json, guid, tree); });
+
+    // each from nothing decoded, as when a response arrives
+    double peak, tree_peak;
+    long allocations, tree_allocations;
+    r = route_response();
+    tree.clear();
+    tree.shrink_to_fit();
+    heap_use([&]() { r.parse(json.data(), json.size()); }, peak, allocations);
+    heap_use([&]() { parse_tree(json, guid, tree); }, tree_peak, tree_allocations);
+
+    printf("%d waypoints, %.1f MB\n", n, json.size() / 1e6);
+    printf("route_response: %6.1f ms, %4.0f ns per waypoint, peak %5.1f MB, %ld allocations\n",
+           ns / 1e6, ns / n, peak, allocations);
+    // jsoncpp keeps its strings with malloc, which is not counted
+    printf("json tree:      %6.1f ms, %4.0f ns per waypoint, peak %5.1f MB, %ld allocations\n",
+           tree_ns / 1e6, tree_ns / n, tree_peak, tree_allocations);
+    CHECK(peak < tree_peak && ns < tree_ns);
+
+    return test_result("route_response");
+}
@@ -0,0 +1,200 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+// segment_index::nearest against closest_seg_batch over the whole route,
+// segment_index::within against testing the distance to every segment,
+// and the time of each lookup as the route grows
+
+#include <math.h>
+#include <algorithm>
+
+#include "route.h"
+#include "test.h"
+
+using namespace computation_gc;
+
+// a random walk of n waypoints with legs up to leg degrees, compiled as
+// far as the segment index needs
+static void random_route(ap_route &route, int n, double leg)
+{
+    route.clear();
+    wp p(uniform(-60, 60), uniform(-180, 180));
+    for(int i=0; i<n; i++) {
+        route.push_back(waypoint(p.lat, p.lon, "", "", .1, 0));
+        p.lat = std::min(std::max(p.lat + uniform(-leg, leg), -80.0), 80.0);
+        p.lon = remainder(p.lon + uniform(-leg, leg), 360);
+    }
+
+    route.points.resize(n);
+    route.segments.resize(n-1);
+    route.segment_arrays.resize(n);
+    for(int i=0; i<n; i++) {
+        wp w = route.point(i);
+        route.points[i] = ll2v(w);
+        route.segment_arrays.set_point(i, route.points[i]);
+    }
+    for(int i=0; i<n-1; i++) {
+        route.segments[i] = segment(route.points[i], route.points[i+1]);
+        route.segment_arrays.set_segment(i, route.segments[i]);
+    }
+}
+
+// position near a random segment of the route
+static vector random_query(ap_route &route)
+{
+    int i = std::uniform_int_distribution<int>(0, route.size() - 2)(test_random);
+    double t = uniform(0, 1);
+    vector &a = route.points[i], &b = route.points[i+1];
+    vector v(a.x + (b.x - a.x)*t + uniform(-1e-3, 1e-3),
+             a.y + (b.y - a.y)*t + uniform(-1e-3, 1e-3),
+             a.z + (b.z - a.z)*t + uniform(-1e-3, 1e-3));
+    v.normalize();
+    return v;
+}
+
+static double chord(vector &c, ap_route &route, int seg)
+{
+    vector v = closest_vector_seg(c, route.segments[seg]);
+    vector d(c.x - v.x, c.y - v.y, c.z - v.z);
+    return d.norm();
+}
+
+// the segments from start within chord of c, tested one by one
+static void within_brute(ap_route &route, vector &c, double radius, int start,
+                         std::vector<int> &segs)
+{
+    segs.clear();
+    for(int i=start; i<route.size()-1; i++)
+        if(chord(c, route, i) <= radius)
+            segs.push_back(i);
+}
+
+// the candidates within returns, sorted and from start, tested for the
+// distance give the segments the brute force finds.  Returns their count
+static int check_within(ap_route &route, segment_index &index, vector &c, double radius,
+                        int start, bool &same)
+{
+    std::vector<int> segs, brute, filtered;
+    index.within(route, c, radius, start, segs);
+    within_brute(route, c, radius, start, brute);
+    for(unsigned int j=0; j<segs.size(); j++)
+        if(chord(c, route, segs[j]) <= radius)
+            filtered.push_back(segs[j]);
+
+    same = same && std::is_sorted(segs.begin(), segs.end()) &&
+        std::adjacent_find(segs.begin(), segs.end()) == segs.end() &&
+        (segs.empty() || (segs.front() >= start && segs.back() < route.size()-1)) &&
+        filtered == brute;
+    return segs.size();
+}
+
+static void test_within(ap_route &route, segment_index &index, int segments)
+{
+    // lookahead circles from meters to beyond a leg, some from the
+    // start of the route and some from further along
+    bool same = true;
+    int found = 0, candidates = 0;
+    for(int i=0; i<2000; i++) {
+        vector c = random_query(route);
+        double radius = pow(10, uniform(-6, -2.5));
+        int start = i & 1 ? 0 : std::uniform_int_distribution<int>(0, segments - 1)(test_random);
+        std::vector<int> brute;
+        within_brute(route, c, radius, start, brute);
+        found += brute.size();
+        candidates += check_within(route, index, c, radius, start, same);
+    }
+    CHECK(same);
+
+    // on a waypoint both segments joining it, and past the last segment none
+    vector w = route.points[segments / 2];
+    std::vector<int> segs;
+    index.within(route, w, 1e-9, 0, segs);
+    CHECK(std::find(segs.begin(), segs.end(), segments / 2 - 1) != segs.end() &&
+          std::find(segs.begin(), segs.end(), segments / 2) != segs.end());
+    index.within(route, w, 1, segments, segs);
+    CHECK(segs.empty());
+
+    std::vector<vector> queries(1024);
+    for(unsigned int i=0; i<queries.size(); i++)
+        queries[i] = random_query(route);
+    int n = std::max(200, 2000000 / segments);
+    double t_index = time_ns(n, [&](int i) {
+            index.within(route, queries[i & 1023], 1e-4, 0, segs);
+            test_sink = segs.size(); });
+    double t_brute = time_ns(std::max(20, n / 10), [&](int i) {
+            within_brute(route, queries[i & 1023], 1e-4, 0, segs);
+            test_sink = segs.size(); });
+    printf("%8d %9.0f ns %9.0f ns  %5.1f segments within, %5.1f candidates\n", segments,
+           t_index, t_brute, found / 2000.0, candidates / 2000.0);
+}
+
+int main()
+{
+    static const int sizes[] = {64, 1000, 10000, 100000};
+    ap_route routes[sizeof sizes / sizeof *sizes];
+    printf("%8s %12s %12s\n", "segments", "nearest", "batch");
+    for(unsigned int k=0; k<sizeof sizes / sizeof *sizes; k++) {
+        ap_route route;
+        random_route(route, sizes[k] + 1, .05);
+        segment_index index;
+        index.build(route);
+
+        // the same segment, or one exactly as close
+        int mismatches = 0;
+        for(int i=0; i<2000; i++) {
+            vector c = random_query(route);
+            int start = i & 1 ? 0 : std::uniform_int_distribution<int>(0, sizes[k] - 1)(test_random);
+            int seg = index.nearest(route, c, start);
+            int batch = closest_seg_batch(c, route.segment_arrays, start, sizes[k]);
+            CHECK(seg >= start && seg < sizes[k]);
+            if(seg != batch) {
+                mismatches++;
+                CHECK(fabs(chord(c, route, seg) - chord(c, route, batch)) < 1e-15);
+            }
+        }
+        CHECK(mismatches < 20);
+
+        std::vector<vector> queries(1024);
+        for(unsigned int i=0; i<queries.size(); i++)
+            queries[i] = random_query(route);
+        int n = std::max(200, 2000000 / sizes[k]);
+        double t_index = time_ns(n, [&](int i) {
+                test_sink = index.nearest(route, queries[i & 1023], 0); });
+        double t_batch = time_ns(n, [&](int i) {
+                test_sink = closest_seg_batch(queries[i & 1023], route.segment_arrays, 0, sizes[k]); });
+        printf("%8d %9.0f ns %9.0f ns\n", sizes[k], t_index, t_batch);
+        routes[k] = route;
+    }
+
+    printf("%8s %12s %12s\n", "segments", "within", "brute force");
+    for(unsigned int k=0; k<sizeof sizes / sizeof *sizes; k++) {
+        segment_index index;
+        index.build(routes[k]);
+        test_within(routes[k], index, sizes[k]);
+    }
+
+    return test_result("segment_index");
+}
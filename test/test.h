@@ -0,0 +1,73 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  autopilot route Plugin
+ * Author:   Sean D'Epagnier
+ *
+ ***************************************************************************
+ *   Copyright (C) 2018 by Sean D'Epagnier                                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ ***************************************************************************
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+// the tests are plain programs that print what failed and exit non zero,
+// and print the benchmark timings for ctest -V
+
+inline int test_failures;
+
+#define CHECK(c) do { if(!(c)) {                                        \
+            fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #c); \
+            test_failures++; } } while(0)
+
+// nanoseconds per call of f, which is called n times
+template<class F> double time_ns(int n, F f)
+{
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for(int i=0; i<n; i++)
+        f(i);
+    return std::chrono::duration<double, std::nano>
+        (std::chrono::steady_clock::now() - t0).count() / n;
+}
+
+// seeded so a failure repeats
+inline std::mt19937 test_random(1);
+
+inline double uniform(double lo, double hi)
+{
+    return std::uniform_real_distribution<double>(lo, hi)(test_random);
+}
+
+// keeps a benchmark result from being optimized away
+inline volatile double test_sink;
+
+inline int test_result(const char *name)
+{
+    if(test_failures)
+        printf("%s: %d failed\n", name, test_failures);
+    else
+        printf("%s: passed\n", name);
+    return test_failures != 0;
+}
+
+#endif